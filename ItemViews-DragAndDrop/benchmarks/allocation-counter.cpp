@@ -0,0 +1,74 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+// Counts the heap allocations, for the benchmarks and for InstrumentedModel (see model-instrumentation.h).
+// This replaces the global allocation functions, which may only be done once per program: that's why it's
+// a source file of its own, rather than part of a header.
+#include "model-instrumentation.h"
+
+#include <cstdlib>
+#include <new>
+
+// No constructor, so that accessing it never allocates
+static thread_local AllocationCount s_allocations;
+
+AllocationCount countedAllocations()
+{
+    return s_allocations;
+}
+
+#ifdef __GLIBC__
+// Most of the allocations of Qt containers (QByteArray, QString, QVector...) don't go through operator new but call
+// malloc() directly, so count those instead. With glibc, the malloc() of the executable takes precedence over the
+// one of the C library, in Qt as well; and the default operator new calls malloc(), so it's counted too.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) __THROW
+{
+    ++s_allocations.count;
+    s_allocations.bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) __THROW
+{
+    ++s_allocations.count;
+    s_allocations.bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+// Growing a buffer is churn too
+void *realloc(void *pointer, size_t size) __THROW
+{
+    ++s_allocations.count;
+    s_allocations.bytes += size;
+    return __libc_realloc(pointer, size);
+}
+}
+#else
+// Elsewhere, only count operator new: the buffers of the Qt containers are missing from the counts then
+void *operator new(std::size_t size)
+{
+    ++s_allocations.count;
+    s_allocations.bytes += size;
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+#endif
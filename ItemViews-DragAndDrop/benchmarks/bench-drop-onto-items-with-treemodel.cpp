@@ -0,0 +1,595 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+// part3's EmailsModel and FoldersModel: dragging emails onto a folder, and folders into another folder
+#include "../part3-dropping-onto-items/treemodel/drop-onto-items-with-treemodel.cpp"
+
+#include "benchmark-data.h"
+#include "benchmark-results.h"
+
+#include <QElapsedTimer>
+#include <QHeaderView>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QTreeView>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+
+// The models of TopLevel, connected the same way, without the views, the index and the journal
+class Mailbox
+{
+public:
+    Mailbox()
+    {
+        m_emailsModel.setEmailStore(&m_emailStore);
+        QObject::connect(&m_emailsModel, &EmailsModel::emailsRemoved, &m_foldersModel, [this](EmailFolder *folder, int row, int count) {
+            Q_UNUSED(row);
+            m_foldersModel.emailCountChanged(folder, -count);
+        });
+        QObject::connect(&m_foldersModel, &FoldersModel::emailsAppended, &m_emailsModel, &EmailsModel::notifyEmailsAppended);
+        QObject::connect(&m_foldersModel, &FoldersModel::emailsAboutToBeRemoved, &m_emailsModel,
+                         &EmailsModel::notifyEmailsAboutToBeRemoved);
+        QObject::connect(&m_foldersModel, &FoldersModel::emailsRemoved, &m_emailsModel, &EmailsModel::notifyEmailsRemoved);
+    }
+
+    // Adds `count` emails to the store, and returns their IDs
+    QVector<int> addEmails(int count, quint32 seed = 1)
+    {
+        SyntheticData generator(seed);
+        QStringList senders;
+        for (int i = 0; i < 500; ++i)
+            senders.append(generator.name() + ' ' + generator.name(2, 3));
+        QVector<int> emailIds;
+        emailIds.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            const QString &sender = senders.at(generator.skewed(0, int(senders.size()) - 1));
+            const qint64 date = 1717416000000 - qint64(i) * 60000; // one a minute, before 2024-06-03
+            emailIds.append(m_emailStore.addEmail(generator.sentence(2, 8), sender, date, generator.skewed(500, 50000)));
+        }
+        return emailIds;
+    }
+
+    EmailStore &emailStore() { return m_emailStore; }
+    EmailFolder *rootFolder() const { return m_rootFolder.get(); }
+    FoldersModel &foldersModel() { return m_foldersModel; }
+    EmailsModel &emailsModel() { return m_emailsModel; }
+
+private:
+    EmailStore m_emailStore;
+    std::unique_ptr<EmailFolder> m_rootFolder = std::make_unique<EmailFolder>(EmailFolder{"HIDDEN ROOT"});
+    FoldersModel m_foldersModel;
+    EmailsModel m_emailsModel;
+};
+
+// Writes an email of the maildir fixture, e.g. "Inbox/cur/1000.a:2,S"
+static void writeMaildirEmail(const QString &rootPath, const QString &path, const QByteArray &headers)
+{
+    const QFileInfo fileInfo(rootPath + '/' + path);
+    QDir().mkpath(fileInfo.path());
+    QFile file(fileInfo.filePath());
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(headers + "\nThe body, which isn't read.\n");
+}
+
+static QStringList maildirFiles(const QString &rootPath, const QString &folderName)
+{
+    QStringList files;
+    for (const QString subdir : {QStringLiteral("cur"), QStringLiteral("new")}) {
+        const QStringList fileNames = QDir(rootPath + '/' + folderName + '/' + subdir).entryList(QDir::Files, QDir::Name);
+        for (const QString &fileName : fileNames)
+            files.append(subdir + '/' + fileName);
+    }
+    return files;
+}
+
+class BenchmarkDropOntoItemsWithTreeModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanupTestCase() { BenchmarkResults::write(); }
+
+    void dragEmails_data() { BenchmarkResults::addRowCounts(); }
+
+    // Dragging 100 emails from the middle of the Inbox, shown in the emails view, onto the Archive folder:
+    // the drag source removes them once FoldersModel accepted the drop, as QAbstractItemView does it
+    void dragEmails()
+    {
+        QFETCH(int, rows);
+        Mailbox mailbox;
+        EmailFolder *inbox = appendFolder(*mailbox.rootFolder(), QStringLiteral("Inbox"), mailbox.addEmails(rows));
+        EmailFolder *archive = appendFolder(*mailbox.rootFolder(), QStringLiteral("Archive"), mailbox.addEmails(1000, 2));
+        FoldersModel &foldersModel = mailbox.foldersModel();
+        EmailsModel &emailsModel = mailbox.emailsModel();
+        foldersModel.setEmailFolders(mailbox.rootFolder());
+        emailsModel.setEmails(inbox);
+        const QModelIndex archiveIndex = foldersModel.indexForFolder(archive);
+
+        const int firstDraggedRow = rows / 2;
+        const int draggedCount = 100;
+        QModelIndexList indexes; // what QTreeView passes: all the columns of the selected rows
+        for (int row = firstDraggedRow; row < firstDraggedRow + draggedCount; ++row) {
+            for (int column = 0; column < emailsModel.columnCount(); ++column)
+                indexes.append(emailsModel.index(row, column));
+        }
+
+        BenchmarkRun run(QStringLiteral("EmailsModel to FoldersModel (part3)"), rows);
+        while (run.next()) {
+            const std::unique_ptr<QMimeData> mimeData(emailsModel.mimeData(indexes));
+            run.lap("mimeData");
+            QVERIFY(foldersModel.dropMimeData(mimeData.get(), Qt::MoveAction, -1, -1, archiveIndex));
+            run.lap("dropMimeData");
+            emailsModel.removeRows(firstDraggedRow, draggedCount, QModelIndex());
+            run.lap("removeRows");
+
+            // Move them back, to the end of the Inbox: the next iteration drags other emails, the same way
+            const int archivedCount = int(archive->emails.size()) - draggedCount;
+            const QVector<int> emailIds = archive->emails.mid(archivedCount);
+            foldersModel.removeEmails(archive, archivedCount, draggedCount);
+            foldersModel.appendEmails(inbox, emailIds);
+        }
+        QCOMPARE(emailsModel.rowCount(), rows);
+        QCOMPARE(inbox->totalEmails, rows);
+        QCOMPARE(int(archive->emails.size()), 1000);
+    }
+
+    // Not a benchmark: moving emails to another folder shouldn't allocate more than a few times per email,
+    // whatever the size of the folders (the sets of email IDs allocate, the emails themselves aren't copied)
+    void dragEmailsAllocations()
+    {
+        if (!BenchmarkResults::countsAllocations())
+            QSKIP("Needs DND_COUNT_ALLOCATIONS and a release build");
+        Mailbox mailbox;
+        EmailFolder *inbox = appendFolder(*mailbox.rootFolder(), QStringLiteral("Inbox"), mailbox.addEmails(100000));
+        EmailFolder *archive = appendFolder(*mailbox.rootFolder(), QStringLiteral("Archive"), mailbox.addEmails(1000, 2));
+        FoldersModel &foldersModel = mailbox.foldersModel();
+        EmailsModel &emailsModel = mailbox.emailsModel();
+        foldersModel.setEmailFolders(mailbox.rootFolder());
+        emailsModel.setEmails(inbox);
+        QModelIndexList indexes;
+        for (int row = 50000; row < 51000; ++row)
+            indexes.append(emailsModel.index(row, EmailsModel::Subject));
+
+        const AllocationCount before = allocationsSoFar();
+        const std::unique_ptr<QMimeData> mimeData(emailsModel.mimeData(indexes));
+        QVERIFY(foldersModel.dropMimeData(mimeData.get(), Qt::MoveAction, -1, -1, foldersModel.indexForFolder(archive)));
+        QVERIFY(emailsModel.removeRows(50000, 1000, QModelIndex()));
+        const quint64 allocations = allocationsSoFar().count - before.count;
+        QVERIFY2(allocations < 3000, qPrintable(QStringLiteral("Moving 1000 emails allocated %1 times").arg(allocations)));
+        QCOMPARE(int(archive->emails.size()), 2000);
+    }
+
+    void dragFolders_data() { BenchmarkResults::addRowCounts(1000, 1000000); }
+
+    // Dragging 10 folders from the middle of `rows` top-level folders onto the first one, which moves them one by one
+    void dragFolders()
+    {
+        QFETCH(int, rows);
+        Mailbox mailbox;
+        for (int i = 0; i < rows; ++i)
+            appendFolder(*mailbox.rootFolder(), QString::number(i));
+        FoldersModel &foldersModel = mailbox.foldersModel();
+        foldersModel.setEmailFolders(mailbox.rootFolder());
+        EmailFolder *destFolder = mailbox.rootFolder()->subFolders.front().get();
+        const QModelIndex destIndex = foldersModel.indexForFolder(destFolder);
+
+        const int firstDraggedRow = rows / 2;
+        const int draggedCount = 10;
+        BenchmarkRun run(QStringLiteral("FoldersModel (part3)"), rows);
+        while (run.next()) {
+            QModelIndexList indexes;
+            for (int row = firstDraggedRow; row < firstDraggedRow + draggedCount; ++row) {
+                for (int column = 0; column < foldersModel.columnCount(); ++column)
+                    indexes.append(foldersModel.index(row, column, QModelIndex()));
+            }
+            run.lap("index");
+            const std::unique_ptr<QMimeData> mimeData(foldersModel.mimeData(indexes));
+            run.lap("mimeData");
+            foldersModel.dropMimeData(mimeData.get(), Qt::MoveAction, -1, -1, destIndex);
+            run.lap("dropMimeData");
+            // No removeRows(): dropMimeData() moved the folders already
+
+            QVERIFY(foldersModel.moveRows(destIndex, 0, draggedCount, QModelIndex(), firstDraggedRow));
+        }
+        QCOMPARE(foldersModel.rowCount(), rows);
+        QVERIFY(destFolder->subFolders.empty());
+    }
+
+    // Not a benchmark: moving a folder to a cousin changes the totals of the folders in between, but not those
+    // of their common ancestor and above, which shouldn't be notified either
+    void moveFolderTotals()
+    {
+        Mailbox mailbox;
+        EmailFolder *archive = appendFolder(*mailbox.rootFolder(), QStringLiteral("Archive"));
+        EmailFolder *from = appendFolder(*archive, QStringLiteral("2023"));
+        EmailFolder *moved = appendFolder(*from, QStringLiteral("December"), mailbox.addEmails(10));
+        EmailFolder *to = appendFolder(*archive, QStringLiteral("2024"));
+        FoldersModel &foldersModel = mailbox.foldersModel();
+        foldersModel.setEmailFolders(mailbox.rootFolder());
+        QCOMPARE(archive->totalEmails, 10);
+
+        QSet<EmailFolder *> changedTotals;
+        connect(&foldersModel, &QAbstractItemModel::dataChanged, this, [&](const QModelIndex &topLeft) {
+            if (topLeft.column() == FoldersModel::TotalEmails)
+                changedTotals.insert(foldersModel.folderForIndex(topLeft));
+        });
+        QVERIFY(foldersModel.moveRows(foldersModel.indexForFolder(from), 0, 1, foldersModel.indexForFolder(to), 0));
+        disconnect(&foldersModel, nullptr, this, nullptr);
+        QCOMPARE(moved->parentFolder, to);
+        QCOMPARE(from->totalEmails, 0);
+        QCOMPARE(to->totalEmails, 10);
+        QCOMPARE(archive->totalEmails, 10);
+        QCOMPARE(mailbox.rootFolder()->totalEmails, 10);
+        QCOMPARE(changedTotals, QSet<EmailFolder *>({from, to}));
+    }
+
+    void switchFolders_data()
+    {
+        QTest::addColumn<int>("rows");
+        QTest::addColumn<bool>("shared");
+        for (int rows : BenchmarkResults::rowCounts(1000, 1000000)) {
+            QTest::addRow("%d emails, no emails in common", rows) << rows << false;
+            QTest::addRow("%d emails, all but 100 in common", rows) << rows << true;
+        }
+    }
+
+    // Clicking on a folder, then on another one, and so on: the time until the emails view shows the new folder,
+    // sorted by date as in TopLevel. Two folders usually have no emails in common (moving emails leaves
+    // them in a single folder), then EmailsModel is reset. After copying emails, they have emails in common,
+    // then EmailsModel removes and inserts the rows which differ, so that the selection is kept.
+    void switchFolders()
+    {
+        QFETCH(int, rows);
+        QFETCH(bool, shared);
+        Mailbox mailbox;
+        const QVector<int> emailIds = mailbox.addEmails(rows);
+        EmailFolder *folders[2];
+        folders[0] = appendFolder(*mailbox.rootFolder(), QStringLiteral("Inbox"), emailIds);
+        if (shared) {
+            // In the same order, with 100 emails removed and 100 added, spread over the folder:
+            // 100 runs of rows to remove and 100 to insert, whatever the size
+            const int step = rows / 100;
+            const QVector<int> newEmailIds = mailbox.addEmails(100, 2);
+            QVector<int> otherEmailIds;
+            otherEmailIds.reserve(rows);
+            for (int row = 0; row < rows; ++row) {
+                if (row % step == 0)
+                    otherEmailIds.append(newEmailIds.at(row / step));
+                if (row % step != step / 2)
+                    otherEmailIds.append(emailIds.at(row));
+            }
+            folders[1] = appendFolder(*mailbox.rootFolder(), QStringLiteral("Copies"), otherEmailIds);
+        } else {
+            folders[1] = appendFolder(*mailbox.rootFolder(), QStringLiteral("Archive"), mailbox.addEmails(rows, 2));
+        }
+        FoldersModel &foldersModel = mailbox.foldersModel();
+        EmailsModel &emailsModel = mailbox.emailsModel();
+        foldersModel.setEmailFolders(mailbox.rootFolder());
+        emailsModel.setEmails(folders[0]);
+
+        EmailsProxyModel proxyModel(&emailsModel);
+        QTreeView view;
+        view.setRootIsDecorated(false);
+        view.setModel(&proxyModel);
+        view.setSortingEnabled(true);
+        view.sortByColumn(EmailsModel::Date, Qt::DescendingOrder);
+        view.header()->resizeSections(QHeaderView::ResizeToContents);
+        view.resize(1000, 800);
+        view.show();
+        QVERIFY(QTest::qWaitForWindowExposed(&view));
+
+        int resets = 0;
+        int insertions = 0;
+        connect(&emailsModel, &QAbstractItemModel::modelReset, this, [&resets] { ++resets; });
+        connect(&emailsModel, &QAbstractItemModel::rowsInserted, this, [&insertions] { ++insertions; });
+
+        int switches = 0;
+        BenchmarkRun run(QStringLiteral("EmailsModel, EmailsProxyModel and QTreeView (part3)"), rows);
+        while (run.next()) {
+            emailsModel.setEmails(folders[++switches % 2]);
+            run.lap("setEmails");
+            view.viewport()->repaint(); // the posted layout happens there
+            run.lap("paint");
+        }
+        // Per switch, to show which path setEmails() took
+        run.setValue(QStringLiteral("modelResets"), double(resets) / switches);
+        run.setValue(QStringLiteral("rowsInserted"), double(insertions) / switches);
+        disconnect(&emailsModel, nullptr, this, nullptr);
+        QCOMPARE(resets, shared ? 0 : switches);
+        QCOMPARE(proxyModel.rowCount(), int(folders[switches % 2]->emails.size()));
+    }
+
+    void siblingFolders_data() { BenchmarkResults::addRowCounts(1000, 100000); }
+
+    // A folder with `rows` subfolders, like a mail archive with a folder per month or per project.
+    // The views call parent() for every index they lay out or paint, and FoldersModel calls indexForFolder()
+    // for every change: both should be O(1), rather than searching the folder among its siblings.
+    // Moving the first folder to the end is O(rows) though, the rows of all its siblings change.
+    void siblingFolders()
+    {
+        QFETCH(int, rows);
+        Mailbox mailbox;
+        EmailFolder *archive = appendFolder(*mailbox.rootFolder(), QStringLiteral("Archive"));
+        for (int i = 0; i < rows; ++i)
+            appendFolder(*archive, QString::number(i));
+        FoldersModel &foldersModel = mailbox.foldersModel();
+        foldersModel.setEmailFolders(mailbox.rootFolder());
+        const QModelIndex archiveIndex = foldersModel.indexForFolder(archive);
+
+        QModelIndexList indexes;
+        indexes.reserve(rows);
+        for (int row = 0; row < rows; ++row)
+            indexes.append(foldersModel.index(row, 0, archiveIndex));
+
+        qint64 checksum = 0; // so that the compiler can't skip the calls
+        BenchmarkRun run(QStringLiteral("FoldersModel (part3)"), rows);
+        while (run.next()) {
+            for (const QModelIndex &index : std::as_const(indexes))
+                checksum += foldersModel.parent(index).row();
+            run.lap("parent");
+            for (const auto &folder : archive->subFolders)
+                checksum += foldersModel.indexForFolder(folder.get()).row();
+            run.lap("indexForFolder");
+            QVERIFY(foldersModel.moveRows(archiveIndex, 0, 1, archiveIndex, rows));
+            run.lap("moveRows");
+
+            QVERIFY(foldersModel.moveRows(archiveIndex, rows - 1, 1, archiveIndex, 0));
+        }
+        QVERIFY(checksum != 0);
+        for (int row = 0; row < rows; ++row)
+            QCOMPARE(archive->subFolders.at(row)->folderName, QString::number(row));
+    }
+
+    void searchAsYouType_data()
+    {
+        QTest::addColumn<int>("rows");
+        QTest::addColumn<bool>("sender");
+        for (int rows : BenchmarkResults::rowCounts(1000, 1000000)) {
+            QTest::addRow("%d emails, common words", rows) << rows << false;
+            QTest::addRow("%d emails, a sender", rows) << rows << true;
+        }
+    }
+
+    // Typing a query in the "search all folders" field, one character at a time: EmailIndex::search() is called on
+    // every keystroke, so its median time is the latency of one keystroke, and the slowest one is reported as well
+    // (usually when the last word reaches 3 characters, and starts matching every word it's a prefix of).
+    // The words of the subjects are few and common, matching a good part of the emails; senders match a few of them.
+    void searchAsYouType()
+    {
+        QFETCH(int, rows);
+        QFETCH(bool, sender);
+        Mailbox mailbox;
+        const QVector<int> emailIds = mailbox.addEmails(rows);
+        EmailFolder *inbox = appendFolder(*mailbox.rootFolder(), QStringLiteral("Inbox"), emailIds);
+        EmailIndex index(&mailbox.emailStore());
+        index.build(mailbox.rootFolder());
+        QTRY_VERIFY_WITH_TIMEOUT(index.isReady(), 60000);
+        const QString query = sender ? mailbox.emailStore().sender(emailIds.first()).toString() : QStringLiteral("meeting report");
+
+        qint64 slowestKeystroke = 0;
+        int matches = 0;
+        QElapsedTimer keystrokeTimer;
+        BenchmarkRun run(QStringLiteral("EmailIndex (part3)"), rows);
+        while (run.next()) {
+            for (int length = 1; length <= query.size(); ++length) {
+                keystrokeTimer.start();
+                matches = int(index.search(query.left(length)).size());
+                slowestKeystroke = std::max(slowestKeystroke, keystrokeTimer.nsecsElapsed());
+                run.lap("keystroke");
+            }
+        }
+        run.setValue(QStringLiteral("slowestKeystrokeNsecs"), double(slowestKeystroke));
+        QVERIFY(matches > 0); // the first email, at least, for the sender
+        QVERIFY(matches <= int(inbox->emails.size()));
+    }
+
+    void decodeHeader_data()
+    {
+        QTest::addColumn<QString>("header");
+        QTest::addColumn<QString>("decoded");
+        QTest::addRow("plain") << QStringLiteral("Hello") << QStringLiteral("Hello");
+        QTest::addRow("base64") << QStringLiteral("=?UTF-8?B?w4l0w6kgMjAyNA==?=") << QString::fromUtf8("Été 2024");
+        QTest::addRow("quoted-printable latin1") << QStringLiteral("=?ISO-8859-1?Q?Fran=E7ois?= <f@example.com>")
+                                                 << QString::fromUtf8("François <f@example.com>");
+        QTest::addRow("adjacent encoded words") << QStringLiteral("=?UTF-8?Q?Caf=C3=A9?= =?UTF-8?Q?_cr=C3=A8me?=")
+                                                << QString::fromUtf8("Café crème");
+        QTest::addRow("mixed") << QStringLiteral("Re: =?utf-8?q?r=C3=A9union?= demain") << QString::fromUtf8("Re: réunion demain");
+        QTest::addRow("unencoded 8-bit") << QString::fromLatin1("\xc3\xa9t\xc3\xa9") << QString::fromUtf8("été");
+        QTest::addRow("unterminated") << QStringLiteral("=?UTF-8?B?w4l0") << QStringLiteral("=?UTF-8?B?w4l0");
+    }
+
+    // Not a benchmark: the subjects and senders of the maildir, as the emails view shows them
+    void decodeHeader()
+    {
+        QFETCH(QString, header);
+        QFETCH(QString, decoded);
+        QCOMPARE(::decodeHeader(header), decoded);
+    }
+
+    // Not a benchmark: MaildirBackend with a generated maildir. Loads it, then moves and copies emails,
+    // including onto a folder which has them already, and checks the files on disk.
+    void maildir()
+    {
+        QTemporaryDir directory;
+        QVERIFY(directory.isValid());
+        const QString rootPath = directory.path();
+        writeMaildirEmail(rootPath, QStringLiteral("Inbox/cur/1000.a:2,S"),
+                          "Subject: =?UTF-8?B?w4l0w6kgMjAyNA==?=\n"
+                          "From: =?ISO-8859-1?Q?Fran=E7ois?= <f@example.com>\n"
+                          "Date: Mon, 03 Jun 2024 08:15:00 +0000\n"
+                          "Message-ID: <1000@example.com>\n");
+        writeMaildirEmail(rootPath, QStringLiteral("Inbox/new/1001.b"),
+                          "Subject: =?UTF-8?Q?Caf=C3=A9?=\n =?UTF-8?Q?_cr=C3=A8me?=\n" // folded
+                          "From: Boss <boss@example.com>\n"
+                          "Content-Type: multipart/mixed; boundary=xyz\n"
+                          "Message-ID: <1001@example.com>\n");
+        // The same message in both folders, e.g. copied by another email client
+        const QByteArray minutes = "Subject: Minutes\nFrom: Boss <boss@example.com>\nMessage-ID: <1002@example.com>\n";
+        writeMaildirEmail(rootPath, QStringLiteral("Inbox/cur/1002.c:2,FS"), minutes);
+        writeMaildirEmail(rootPath, QStringLiteral("Archive/cur/1002.c:2,FS"), minutes);
+        for (const char *folderName : {"Inbox", "Archive"}) {
+            for (const char *subdir : {"cur", "new", "tmp"})
+                QVERIFY(QDir(rootPath).mkpath(QString::fromLatin1(folderName) + '/' + QLatin1String(subdir)));
+        }
+
+        Mailbox mailbox;
+        MaildirBackend maildir(rootPath);
+        const QVector<EmailFolderLoader::Folder> loadedFolders = maildir.subFolderLister()(QString(), mailbox.emailStore());
+        QCOMPARE(int(loadedFolders.size()), 2);
+        QCOMPARE(loadedFolders.at(0).name, QStringLiteral("Archive"));
+        QCOMPARE(loadedFolders.at(1).name, QStringLiteral("Inbox"));
+        EmailFolder *archive = appendFolder(*mailbox.rootFolder(), loadedFolders.at(0).name, loadedFolders.at(0).emails);
+        EmailFolder *inbox = appendFolder(*mailbox.rootFolder(), loadedFolders.at(1).name, loadedFolders.at(1).emails);
+        FoldersModel &foldersModel = mailbox.foldersModel();
+        EmailsModel &emailsModel = mailbox.emailsModel();
+        foldersModel.setEmailFolders(mailbox.rootFolder());
+        maildir.setFolderPath(archive->id, archive->folderName);
+        maildir.setFolderPath(inbox->id, inbox->folderName);
+        QObject::connect(&foldersModel, &FoldersModel::emailsTransferred, &foldersModel,
+                         [&](EmailFolder *sourceFolder, EmailFolder *destFolder, const QVector<int> &emailIds, Qt::DropAction action,
+                             const QVector<int> &appendedEmailIds) {
+                             maildir.transferEmails(sourceFolder, destFolder, emailIds, action, appendedEmailIds, mailbox.emailStore());
+                         });
+
+        // Each file is an email, the copies of the same message too
+        const EmailStore &emailStore = mailbox.emailStore();
+        QCOMPARE(emailStore.count(), 4);
+        QCOMPARE(int(archive->emails.size()), 1);
+        QCOMPARE(int(inbox->emails.size()), 3);
+        const auto inboxEmail = [&](const QString &location) {
+            for (int id : std::as_const(inbox->emails)) {
+                if (emailStore.location(id) == location)
+                    return id;
+            }
+            return -1;
+        };
+        const int summerEmail = inboxEmail(QStringLiteral("cur/1000.a:2,S"));
+        const int cafeEmail = inboxEmail(QStringLiteral("new/1001.b"));
+        const int minutesEmail = inboxEmail(QStringLiteral("cur/1002.c:2,FS"));
+        QVERIFY(summerEmail >= 0 && cafeEmail >= 0 && minutesEmail >= 0);
+        QCOMPARE(emailStore.displaySubject(summerEmail), QString::fromUtf8("Été 2024"));
+        QCOMPARE(emailStore.sender(summerEmail).toString(), QString::fromUtf8("François <f@example.com>"));
+        QCOMPARE(emailStore.date(summerEmail), QDateTime::fromString(QStringLiteral("2024-06-03T08:15:00Z"), Qt::ISODate).toMSecsSinceEpoch());
+        QCOMPARE(emailStore.flags(summerEmail) & ~quint64(EmailStore::RawSubject), quint64(EmailStore::NoFlags));
+        QCOMPARE(emailStore.displaySubject(cafeEmail), QString::fromUtf8("Café crème"));
+        QCOMPARE(emailStore.flags(cafeEmail) & ~quint64(EmailStore::RawSubject), quint64(EmailStore::Unread | EmailStore::HasAttachment));
+        QCOMPARE(emailStore.displaySubject(minutesEmail), QStringLiteral("Minutes"));
+        QCOMPARE(emailStore.displaySubject(archive->emails.first()), QStringLiteral("Minutes"));
+        QCOMPARE(emailStore.flags(minutesEmail) & ~quint64(EmailStore::RawSubject), quint64(EmailStore::Flagged));
+
+        // Drags rows of the Inbox onto the Archive, as the emails view would
+        const auto dragToArchive = [&](int emailId, Qt::DropAction action) {
+            emailsModel.setEmails(inbox);
+            const int row = int(inbox->emails.indexOf(emailId));
+            const std::unique_ptr<QMimeData> mimeData(emailsModel.mimeData({emailsModel.index(row, EmailsModel::Subject)}));
+            QVERIFY(foldersModel.dropMimeData(mimeData.get(), action, -1, -1, foldersModel.indexForFolder(archive)));
+            if (action == Qt::MoveAction)
+                QVERIFY(emailsModel.removeRows(row, 1, QModelIndex()));
+        };
+        dragToArchive(summerEmail, Qt::CopyAction);
+        QCOMPARE(maildirFiles(rootPath, QStringLiteral("Archive")), QStringList({"cur/1000.a:2,S", "cur/1002.c:2,FS"}));
+        QCOMPARE(maildirFiles(rootPath, QStringLiteral("Inbox")), QStringList({"cur/1000.a:2,S", "cur/1002.c:2,FS", "new/1001.b"}));
+        // Already in the Archive, in memory and on disk: only deleted from the Inbox
+        dragToArchive(summerEmail, Qt::MoveAction);
+        QCOMPARE(int(archive->emails.size()), 2);
+        QCOMPARE(maildirFiles(rootPath, QStringLiteral("Archive")), QStringList({"cur/1000.a:2,S", "cur/1002.c:2,FS"}));
+        QCOMPARE(maildirFiles(rootPath, QStringLiteral("Inbox")), QStringList({"cur/1002.c:2,FS", "new/1001.b"}));
+        // Another email ID, but the same file is in the Archive already
+        dragToArchive(minutesEmail, Qt::MoveAction);
+        QCOMPARE(maildirFiles(rootPath, QStringLiteral("Archive")), QStringList({"cur/1000.a:2,S", "cur/1002.c:2,FS"}));
+        QCOMPARE(maildirFiles(rootPath, QStringLiteral("Inbox")), QStringList({"new/1001.b"}));
+        dragToArchive(cafeEmail, Qt::MoveAction);
+        QCOMPARE(maildirFiles(rootPath, QStringLiteral("Archive")), QStringList({"cur/1000.a:2,S", "cur/1002.c:2,FS", "new/1001.b"}));
+        QVERIFY(maildirFiles(rootPath, QStringLiteral("Inbox")).isEmpty());
+    }
+
+    // Not a benchmark: the changes recorded by EmailJournal survive the application being killed.
+    // journalWriter() makes them, in another process, which is killed once they are written.
+    void journalReplay()
+    {
+        QTemporaryDir directory;
+        QVERIFY(directory.isValid());
+        QProcess writer;
+        QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+        environment.insert(QStringLiteral("DND_JOURNAL_DIRECTORY"), directory.path());
+        writer.setProcessEnvironment(environment);
+        writer.start(QCoreApplication::applicationFilePath(), {QStringLiteral("journalWriter")});
+        QVERIFY(writer.waitForStarted());
+        QByteArray output;
+        while (!output.contains("journal written") && writer.waitForReadyRead(30000))
+            output += writer.readAllStandardOutput();
+        QVERIFY2(output.contains("journal written"), output.constData());
+        writer.kill(); // no destructors, like a crash
+        QVERIFY(writer.waitForFinished());
+
+        EmailStore emailStore;
+        EmailFolder rootFolder{"HIDDEN ROOT"};
+        EmailJournal journal(directory.path());
+        QVERIFY(journal.restore(emailStore, rootFolder));
+        QCOMPARE(emailStore.count(), 100);
+        QCOMPARE(int(rootFolder.subFolders.size()), 2); // "Trash" was deleted
+        const EmailFolder *inbox = rootFolder.subFolders.at(0).get();
+        const EmailFolder *archive = rootFolder.subFolders.at(1).get();
+        QCOMPARE(inbox->folderName, QStringLiteral("Inbox"));
+        QCOMPARE(archive->folderName, QStringLiteral("Archive"));
+        QVERIFY(inbox->subFolders.empty());
+        // "2024" was created in the Inbox after the snapshot, received emails, then moved to the Archive
+        QCOMPARE(int(archive->subFolders.size()), 1);
+        const EmailFolder *newFolder = archive->subFolders.at(0).get();
+        QCOMPARE(newFolder->folderName, QStringLiteral("2024"));
+        QCOMPARE(newFolder->parentFolder, archive);
+        QVector<int> movedEmails;
+        for (int id = 0; id < 10; ++id)
+            movedEmails.append(id);
+        QCOMPARE(newFolder->emails, movedEmails);
+        QCOMPARE(int(inbox->emails.size()), 90);
+        QCOMPARE(inbox->emails.first(), 10);
+    }
+
+    // Run by journalReplay() in another process, skipped otherwise
+    void journalWriter()
+    {
+        const QString directory = qEnvironmentVariable("DND_JOURNAL_DIRECTORY");
+        if (directory.isEmpty())
+            QSKIP("Run by journalReplay()");
+        Mailbox mailbox;
+        EmailFolder *inbox = appendFolder(*mailbox.rootFolder(), QStringLiteral("Inbox"), mailbox.addEmails(100));
+        EmailFolder *archive = appendFolder(*mailbox.rootFolder(), QStringLiteral("Archive"));
+        FoldersModel &foldersModel = mailbox.foldersModel();
+        EmailsModel &emailsModel = mailbox.emailsModel();
+        foldersModel.setEmailFolders(mailbox.rootFolder());
+        emailsModel.setEmails(inbox);
+
+        EmailJournal journal(directory);
+        journal.compact(mailbox.emailStore(), *mailbox.rootFolder());
+        QTRY_VERIFY(!journal.isCompacting());
+        journal.recordChanges(&foldersModel);
+
+        // After the snapshot: all of these only exist in the journal
+        EmailFolder *newFolder = foldersModel.createFolder(inbox, QStringLiteral("2024"));
+        EmailFolder *trash = foldersModel.createFolder(mailbox.rootFolder(), QStringLiteral("Trash"));
+        QModelIndexList indexes;
+        for (int row = 0; row < 10; ++row)
+            indexes.append(emailsModel.index(row, EmailsModel::Subject));
+        const std::unique_ptr<QMimeData> mimeData(emailsModel.mimeData(indexes));
+        QVERIFY(foldersModel.dropMimeData(mimeData.get(), Qt::MoveAction, -1, -1, foldersModel.indexForFolder(newFolder)));
+        QVERIFY(emailsModel.removeRows(0, 10, QModelIndex()));
+        QVERIFY(foldersModel.moveRows(foldersModel.indexForFolder(inbox), newFolder->row, 1, foldersModel.indexForFolder(archive), 0));
+        foldersModel.deleteFolder(trash);
+
+        QTRY_VERIFY(!journal.hasUnwrittenRecords());
+        std::fputs("journal written\n", stdout);
+        std::fflush(stdout);
+        QTest::qWait(60000); // until journalReplay() kills this process
+    }
+};
+
+QTEST_MAIN(BenchmarkDropOntoItemsWithTreeModel)
+
+#include "bench-drop-onto-items-with-treemodel.moc"
@@ -0,0 +1,69 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+// part2's TreeModel, moving nodes from one model to another: mimeData() encodes node pointers,
+// dropMimeData() inserts clones of the nodes, and the view calls removeRows() on the source model
+#include "treemodel.h"
+
+#include "benchmark-data.h"
+#include "benchmark-results.h"
+
+#include <QMimeData>
+#include <QTest>
+
+#include <memory>
+
+class BenchmarkMoveBetweenTreeViews : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanupTestCase() { BenchmarkResults::write(); }
+
+    void dragAndDrop_data() { BenchmarkResults::addRowCounts(); }
+
+    // Dragging 50 nodes from a parent in the middle of the first tree to the top level of the second one,
+    // then moving them back (not timed)
+    void dragAndDrop()
+    {
+        QFETCH(int, rows);
+        TreeModel model1(BenchmarkData::treeText(rows));
+        TreeModel model2(BenchmarkData::treeText(1000, 2));
+        const QModelIndex sourceParent = model1.index(model1.rowCount() / 2, 0);
+        const int draggedRows = 50;
+        const auto draggedIndexes = [](const TreeModel &model, int firstRow, int count, const QModelIndex &parent) {
+            QModelIndexList indexes; // what QTreeView passes: all the columns of the selected rows
+            for (int row = firstRow; row < firstRow + count; ++row) {
+                for (int column = 0; column < model.columnCount(); ++column)
+                    indexes.append(model.index(row, column, parent));
+            }
+            return indexes;
+        };
+        QModelIndexList indexes = draggedIndexes(model1, 0, draggedRows, sourceParent);
+
+        BenchmarkRun run(QStringLiteral("TreeModel (part2)"), rows);
+        while (run.next()) {
+            const std::unique_ptr<QMimeData> mimeData(model1.mimeData(indexes));
+            run.lap("mimeData");
+            QVERIFY(model2.dropMimeData(mimeData.get(), Qt::MoveAction, -1, -1, QModelIndex()));
+            run.lap("dropMimeData");
+            model1.removeRows(0, draggedRows, sourceParent); // the selection is one range of rows
+            run.lap("removeRows");
+
+            // The nodes are cloned, the indexes of the next iteration are the ones of the clones moved back
+            const int firstMovedRow = model2.rowCount() - draggedRows;
+            const std::unique_ptr<QMimeData> undoMimeData(model2.mimeData(draggedIndexes(model2, firstMovedRow, draggedRows, QModelIndex())));
+            model1.dropMimeData(undoMimeData.get(), Qt::MoveAction, 0, 0, sourceParent);
+            model2.removeRows(firstMovedRow, draggedRows);
+            indexes = draggedIndexes(model1, 0, draggedRows, sourceParent);
+        }
+        QCOMPARE(model1.rowCount(sourceParent), BenchmarkData::treeFanout - 1);
+    }
+};
+
+QTEST_MAIN(BenchmarkMoveBetweenTreeViews)
+
+#include "bench-move-between-tree-views.moc"
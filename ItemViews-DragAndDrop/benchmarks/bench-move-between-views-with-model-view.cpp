@@ -0,0 +1,255 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+// part2's CountryModel, moving rows from one model to another: mimeData() serializes the countries,
+// dropMimeData() inserts them in the other model, and the view calls removeRows() on the source model
+#include "../part2-moving-items-between-views/model-view/move-between-views-with-model-view.cpp"
+
+#include "benchmark-data.h"
+#include "benchmark-results.h"
+
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <memory>
+
+// The same rows as BenchmarkData::countries(), in a countries file
+static bool writeCountryFile(const QString &fileName, int rows, quint32 seed = 1)
+{
+    SyntheticData generator(seed);
+    return MappedCountries::writeFile(fileName, rows, [&generator](qint64) {
+        return QPair<QString, int>{generator.name(), generator.skewed(1, 1500, 4.0)};
+    });
+}
+
+// What CountryModel::populationStats() should return, computed from scratch
+static CountryModel::PopulationStats recomputePopulationStats(const CountryModel &model)
+{
+    CountryModel::PopulationStats stats;
+    for (int row = 0; row < model.rowCount(); ++row) {
+        const int population = model.index(row, CountryModel::Population).data().toInt();
+        stats.min = stats.count == 0 ? population : std::min(stats.min, population);
+        stats.max = stats.count == 0 ? population : std::max(stats.max, population);
+        stats.sum += population;
+        ++stats.count;
+    }
+    return stats;
+}
+
+static void comparePopulationStats(CountryModel &model)
+{
+    const CountryModel::PopulationStats expected = recomputePopulationStats(model);
+    const CountryModel::PopulationStats actual = model.populationStats();
+    QCOMPARE(actual.count, expected.count);
+    QCOMPARE(actual.sum, expected.sum);
+    if (expected.count > 0) {
+        QCOMPARE(actual.min, expected.min);
+        QCOMPARE(actual.max, expected.max);
+    }
+}
+
+class BenchmarkMoveBetweenViewsWithModelView : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanupTestCase() { BenchmarkResults::write(); }
+
+    void dragAndDrop_data()
+    {
+        QTest::addColumn<int>("rows");
+        QTest::addColumn<bool>("file");
+        for (int rows : BenchmarkResults::rowCounts()) {
+            QTest::addRow("%d rows in memory", rows) << rows << false;
+            QTest::addRow("%d rows in a file", rows) << rows << true;
+        }
+    }
+
+    // Dragging 100 rows from the middle of the "Available" model to the end of the "Selected" one,
+    // then moving them back (not timed)
+    void dragAndDrop()
+    {
+        QFETCH(int, rows);
+        QFETCH(bool, file);
+        CountryModel available;
+        QTemporaryDir directory;
+        if (file) {
+            const QString fileName = directory.filePath(QStringLiteral("countries"));
+            QVERIFY(writeCountryFile(fileName, rows));
+            QVERIFY(available.setCountryFile(fileName));
+        } else {
+            available.setCountryData(BenchmarkData::countries<CountryData>(rows));
+        }
+        CountryModel selected;
+        selected.setCountryData(BenchmarkData::countries<CountryData>(1000, 2));
+
+        const int firstDraggedRow = rows / 2;
+        const int draggedRows = 100;
+        const auto draggedIndexes = [](const CountryModel &model, int firstRow, int count) {
+            QModelIndexList indexes; // what QTreeView passes: all the columns of the selected rows
+            for (int row = firstRow; row < firstRow + count; ++row) {
+                for (int column = 0; column < model.columnCount(); ++column)
+                    indexes.append(model.index(row, column));
+            }
+            return indexes;
+        };
+        const QModelIndexList indexes = draggedIndexes(available, firstDraggedRow, draggedRows);
+
+        BenchmarkRun run(file ? QStringLiteral("CountryModel (part2, file)") : QStringLiteral("CountryModel (part2)"), rows);
+        while (run.next()) {
+            const std::unique_ptr<QMimeData> mimeData(available.mimeData(indexes));
+            run.lap("mimeData");
+            QVERIFY(selected.dropMimeData(mimeData.get(), Qt::MoveAction, selected.rowCount(), 0, QModelIndex()));
+            run.lap("dropMimeData");
+            available.removeRows(firstDraggedRow, draggedRows, QModelIndex()); // the selection is one range of rows
+            run.lap("removeRows");
+
+            const int firstSelectedRow = selected.rowCount() - draggedRows;
+            const std::unique_ptr<QMimeData> undoMimeData(selected.mimeData(draggedIndexes(selected, firstSelectedRow, draggedRows)));
+            available.dropMimeData(undoMimeData.get(), Qt::MoveAction, firstDraggedRow, 0, QModelIndex());
+            selected.removeRows(firstSelectedRow, draggedRows, QModelIndex());
+        }
+        QCOMPARE(available.rowCount(), rows);
+    }
+
+    // Not a benchmark: moving rows to the other model shouldn't allocate more than a few times per row, whatever
+    // the size of the models (each country name is decoded into a new QString, the rest is mostly amortized growth)
+    void moveAllocations()
+    {
+        if (!BenchmarkResults::countsAllocations())
+            QSKIP("Needs DND_COUNT_ALLOCATIONS and a release build");
+        CountryModel available;
+        available.setCountryData(BenchmarkData::countries<CountryData>(100000));
+        CountryModel selected;
+        selected.setCountryData(BenchmarkData::countries<CountryData>(1000, 2));
+        QModelIndexList indexes;
+        for (int row = 50000; row < 51000; ++row)
+            indexes.append(available.index(row, 0));
+
+        const AllocationCount before = allocationsSoFar();
+        const std::unique_ptr<QMimeData> mimeData(available.mimeData(indexes));
+        QVERIFY(selected.dropMimeData(mimeData.get(), Qt::MoveAction, selected.rowCount(), 0, QModelIndex()));
+        QVERIFY(available.removeRows(50000, 1000, QModelIndex()));
+        const quint64 allocations = allocationsSoFar().count - before.count;
+        QVERIFY2(allocations < 3000, qPrintable(QStringLiteral("Moving 1000 rows allocated %1 times").arg(allocations)));
+    }
+
+    // Not a benchmark: the population stats are updated incrementally on every drop, removal and move,
+    // and for files, computed in the background meanwhile. Random operations on two models, comparing
+    // the stats with a full recompute along the way.
+    void populationStats_data()
+    {
+        QTest::addColumn<bool>("file");
+        QTest::addColumn<quint32>("seed");
+        for (quint32 seed = 1; seed <= 3; ++seed) {
+            QTest::addRow("in memory, seed %u", seed) << false << seed;
+            QTest::addRow("in a file, seed %u", seed) << true << seed;
+        }
+    }
+
+    void populationStats()
+    {
+        QFETCH(bool, file);
+        QFETCH(quint32, seed);
+        // Files need more rows than a scan chunk (64K), for the operations to happen in the middle of a scan
+        const int rows = file ? 150000 : 2000;
+        const int operations = file ? 300 : 2000;
+        CountryModel models[2];
+        QTemporaryDir directory;
+        QString fileNames[2];
+        for (int i = 0; i < 2; ++i) {
+            if (file) {
+                fileNames[i] = directory.filePath(QString::number(i));
+                QVERIFY(writeCountryFile(fileNames[i], rows, seed + i));
+                QVERIFY(models[i].setCountryFile(fileNames[i]));
+            } else {
+                models[i].setCountryData(BenchmarkData::countries<CountryData>(rows, seed + i));
+            }
+        }
+
+        QRandomGenerator random(seed);
+        // A random range of rows, of up to 100 rows
+        const auto randomRange = [&random](const CountryModel &model, int *firstRow, int *count) {
+            *firstRow = random.bounded(model.rowCount());
+            *count = random.bounded(1, std::min(100, model.rowCount() - *firstRow) + 1);
+        };
+        for (int operation = 0; operation < operations; ++operation) {
+            const int source = random.bounded(2);
+            CountryModel &model = models[source];
+            if (model.rowCount() <= 100 || (file && random.bounded(20) == 0)) {
+                // Start over, with some rows to operate on, and (for files) another scan to interfere with
+                if (file)
+                    QVERIFY(model.setCountryFile(fileNames[source]));
+                else
+                    model.setCountryData(BenchmarkData::countries<CountryData>(rows, seed + source));
+            } else if (random.bounded(3) == 0) { // drag and drop to the other model
+                CountryModel &destModel = models[1 - source];
+                int firstRow, count;
+                randomRange(model, &firstRow, &count);
+                QModelIndexList indexes;
+                for (int row = firstRow; row < firstRow + count; ++row)
+                    indexes.append(model.index(row, CountryModel::Country));
+                const std::unique_ptr<QMimeData> mimeData(model.mimeData(indexes));
+                const int destRow = random.bounded(2) ? random.bounded(destModel.rowCount() + 1) : -1; // -1: append
+                QVERIFY(destModel.dropMimeData(mimeData.get(), Qt::MoveAction, destRow, 0, QModelIndex()));
+                QVERIFY(model.removeRows(firstRow, count, QModelIndex()));
+            } else if (random.bounded(2) == 0) {
+                int firstRow, count;
+                randomRange(model, &firstRow, &count);
+                QVERIFY(model.removeRows(firstRow, count, QModelIndex()));
+            } else {
+                int firstRow, count;
+                randomRange(model, &firstRow, &count);
+                const int destRow = random.bounded(model.rowCount() + 1);
+                model.moveRows(QModelIndex(), firstRow, count, QModelIndex(), destRow); // false if it's a no-op
+            }
+
+            // Let the scan of the files go on, one chunk at a time
+            if (random.bounded(4) == 0)
+                QCoreApplication::processEvents();
+            if (random.bounded(file ? 16 : 1) == 0) { // this finishes the scan
+                comparePopulationStats(models[random.bounded(2)]);
+                if (QTest::currentTestFailed())
+                    return;
+            }
+        }
+
+        // And once the scans finished by themselves
+        for (CountryModel &model : models) {
+            QTRY_VERIFY(model.hasPopulationStats());
+            comparePopulationStats(model);
+            if (QTest::currentTestFailed())
+                return;
+        }
+    }
+
+    // Not a benchmark: editing a file while its stats are computed doesn't hold the scan back.
+    // With an edit between any two chunks, restarting the scan after each edit would never finish.
+    void populationStatsDuringEdits()
+    {
+        QTemporaryDir directory;
+        const QString fileName = directory.filePath(QStringLiteral("countries"));
+        const int rows = 300000;
+        QVERIFY(writeCountryFile(fileName, rows, 1));
+        CountryModel model;
+        QVERIFY(model.setCountryFile(fileName));
+        const int chunks = (rows + 64 * 1024 - 1) / (64 * 1024);
+        QRandomGenerator random(1);
+        for (int round = 0; round < 10 * chunks && !model.hasPopulationStats(); ++round) {
+            // Anywhere: in the part scanned already or not
+            QVERIFY(model.removeRows(random.bounded(model.rowCount()), 1, QModelIndex()));
+            model.moveRows(QModelIndex(), random.bounded(model.rowCount()), 1, QModelIndex(), random.bounded(model.rowCount() + 1));
+            QCoreApplication::processEvents();
+        }
+        QVERIFY(model.hasPopulationStats());
+        comparePopulationStats(model);
+    }
+};
+
+QTEST_MAIN(BenchmarkMoveBetweenViewsWithModelView)
+
+#include "bench-move-between-views-with-model-view.moc"
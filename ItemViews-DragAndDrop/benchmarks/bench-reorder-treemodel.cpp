@@ -0,0 +1,69 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+// part1's TreeModel, moving nodes within the model: mimeData() encodes node pointers,
+// dropMimeData() removes each node from its parent and inserts it into the new one
+#include "treemodel.h"
+
+#include "benchmark-data.h"
+#include "benchmark-results.h"
+
+#include <QLoggingCategory>
+#include <QMimeData>
+#include <QTest>
+
+#include <memory>
+
+class BenchmarkReorderTreeModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase()
+    {
+        QLoggingCategory::setFilterRules(QStringLiteral("default.debug=false")); // dropMimeData() prints every drop
+    }
+
+    void cleanupTestCase() { BenchmarkResults::write(); }
+
+    void dragAndDrop_data() { BenchmarkResults::addRowCounts(); }
+
+    // Dragging 50 nodes from a parent in the middle of the tree onto the first top-level node,
+    // then moving them back (not timed)
+    void dragAndDrop()
+    {
+        QFETCH(int, rows);
+        TreeModel model(BenchmarkData::treeText(rows));
+        const QModelIndex sourceParent = model.index(model.rowCount() / 2, 0);
+        const QModelIndex destParent = model.index(0, 0);
+        const int draggedRows = 50;
+        QModelIndexList indexes; // what QTreeView passes: all the columns of the selected rows
+        for (int row = 0; row < draggedRows; ++row) {
+            for (int column = 0; column < model.columnCount(); ++column)
+                indexes.append(model.index(row, column, sourceParent));
+        }
+
+        BenchmarkRun run(QStringLiteral("TreeModel (part1)"), rows);
+        while (run.next()) {
+            const std::unique_ptr<QMimeData> mimeData(model.mimeData(indexes));
+            run.lap("mimeData");
+            model.dropMimeData(mimeData.get(), Qt::MoveAction, 0, 0, destParent);
+            run.lap("dropMimeData");
+            // No removeRows(): dropMimeData() moved the nodes already
+
+            QModelIndexList movedIndexes;
+            for (int row = 0; row < draggedRows; ++row)
+                movedIndexes.append(model.index(row, 0, destParent));
+            const std::unique_ptr<QMimeData> undoMimeData(model.mimeData(movedIndexes));
+            model.dropMimeData(undoMimeData.get(), Qt::MoveAction, 0, 0, sourceParent);
+        }
+        QCOMPARE(model.rowCount(sourceParent), BenchmarkData::treeFanout - 1);
+    }
+};
+
+QTEST_MAIN(BenchmarkReorderTreeModel)
+
+#include "bench-reorder-treemodel.moc"
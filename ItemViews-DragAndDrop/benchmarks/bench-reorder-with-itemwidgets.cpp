@@ -0,0 +1,163 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+// part1's item widgets: the time from creating a widget to its first paint, filling it one row at a time
+// as the example used to, or with populateListWidget(), populateTableWidget() and populateTreeWidget()
+#include "../part1-reordering-elements/itemwidgets/reorder-with-itemwidgets.cpp"
+
+#include "benchmark-data.h"
+#include "benchmark-results.h"
+
+#include <QElapsedTimer>
+#include <QTest>
+
+#include <memory>
+
+// Notices the first paint of a view, i.e. once it has laid out its rows
+class PaintWatcher : public QObject
+{
+public:
+    explicit PaintWatcher(QAbstractItemView *view)
+    {
+        view->viewport()->installEventFilter(this);
+    }
+
+    bool painted() const { return m_painted; }
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override
+    {
+        if (event->type() == QEvent::Paint)
+            m_painted = true; // the paint event itself is processed right after this, in the same processEvents()
+        return QObject::eventFilter(watched, event);
+    }
+
+private:
+    bool m_painted = false;
+};
+
+static void setupTableItem(QTableWidgetItem *item)
+{
+    item->setFlags(item->flags() & ~Qt::ItemIsDropEnabled);
+}
+
+static void setupTreeItem(QTreeWidgetItem *item)
+{
+    item->setFlags(item->flags() & ~Qt::ItemIsDropEnabled);
+}
+
+// How the example filled the widgets before the populate functions: one notification per row, or per cell
+static void populateListWidgetPerRow(QListWidget *listWidget, const QVector<CountryData> &data)
+{
+    for (const CountryData &countryData : data) {
+        QListWidgetItem *item = new QListWidgetItem(countryData.country);
+        listWidget->addItem(item);
+    }
+}
+
+static void populateTableWidgetPerRow(QTableWidget *tableWidget, const QVector<CountryData> &data)
+{
+    tableWidget->setRowCount(data.count());
+    for (int row = 0; row < data.count(); ++row) {
+        const CountryData &countryData = data.at(row);
+        auto countryItem = new QTableWidgetItem(countryData.country);
+        setupTableItem(countryItem);
+        tableWidget->setItem(row, 0, countryItem);
+        auto populationItem = new QTableWidgetItem;
+        setupTableItem(populationItem);
+        populationItem->setData(Qt::DisplayRole, countryData.population);
+        tableWidget->setItem(row, 1, populationItem);
+        // No vertical header items, like populateTableWidget(): the comparison is about filling the cells
+    }
+}
+
+static void populateTreeWidgetPerRow(QTreeWidget *treeWidget, const QVector<CountryData> &data)
+{
+    for (const CountryData &countryData : data) {
+        auto item = new QTreeWidgetItem;
+        item->setData(0, Qt::DisplayRole, countryData.country);
+        item->setData(1, Qt::DisplayRole, countryData.population);
+        setupTreeItem(item);
+        treeWidget->addTopLevelItem(item);
+    }
+}
+
+class BenchmarkReorderWithItemWidgets : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanupTestCase() { BenchmarkResults::write(); }
+
+    void firstPaint_data()
+    {
+        QTest::addColumn<QString>("widget");
+        QTest::addColumn<bool>("perRow");
+        for (const char *widget : {"list", "table", "tree"}) {
+            QTest::addRow("%s, one row at a time", widget) << QString::fromLatin1(widget) << true;
+            QTest::addRow("%s, populate function", widget) << QString::fromLatin1(widget) << false;
+        }
+    }
+
+    // 500k rows, whatever DND_BENCHMARK_MAX_ROWS says: the size the populate functions were written for.
+    // The widgets are filled before being shown, like in the example.
+    void firstPaint()
+    {
+        QFETCH(QString, widget);
+        QFETCH(bool, perRow);
+        const int rows = 500000;
+        const QVector<CountryData> data = BenchmarkData::countries<CountryData>(rows);
+
+        BenchmarkRun run(QStringLiteral("Q%1Widget (part1)").arg(widget.at(0).toUpper() + widget.mid(1)), rows);
+        while (run.next()) {
+            std::unique_ptr<QAbstractItemView> view;
+            if (widget == QLatin1String("list")) {
+                auto listWidget = new QListWidget;
+                view.reset(listWidget);
+                if (perRow)
+                    populateListWidgetPerRow(listWidget, data);
+                else
+                    populateListWidget(listWidget, data);
+            } else if (widget == QLatin1String("table")) {
+                auto tableWidget = new ReorderableTableWidget;
+                view.reset(tableWidget);
+                tableWidget->setColumnCount(2);
+                tableWidget->setHorizontalHeaderLabels({"Country", "Population (millions)"});
+                if (perRow)
+                    populateTableWidgetPerRow(tableWidget, data);
+                else
+                    populateTableWidget(tableWidget, data, setupTableItem);
+            } else {
+                auto treeWidget = new QTreeWidget;
+                view.reset(treeWidget);
+                treeWidget->setColumnCount(2);
+                treeWidget->setHeaderLabels({"Country", "Population (millions)"});
+                if (perRow)
+                    populateTreeWidgetPerRow(treeWidget, data);
+                else
+                    populateTreeWidget(treeWidget, data, setupTreeItem);
+            }
+            run.lap("populate");
+
+            const PaintWatcher paintWatcher(view.get());
+            view->resize(300, 400);
+            view->show();
+            QElapsedTimer timeout;
+            timeout.start();
+            while (!paintWatcher.painted() && timeout.elapsed() < 60000)
+                QCoreApplication::processEvents();
+            QVERIFY(paintWatcher.painted());
+            run.lap("firstPaint");
+
+            QCOMPARE(view->model()->rowCount(), rows);
+            // Deleting the widget, at the end of the iteration, isn't timed
+        }
+    }
+};
+
+QTEST_MAIN(BenchmarkReorderWithItemWidgets)
+
+#include "bench-reorder-with-itemwidgets.moc"
@@ -0,0 +1,270 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+// part1's CountryModel, reordering rows: mimeData() encodes the row numbers, dropMimeData() calls moveRows()
+#include "../part1-reordering-elements/model-view/reorder-with-model-view.cpp"
+
+#include "benchmark-data.h"
+#include "benchmark-results.h"
+
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// How CountryModel stored its rows before CountryColumns: an array of records, one QString per row.
+// Only what the comparisons below need: data() and sort().
+class CountryRecordsModel : public QAbstractTableModel
+{
+public:
+    void setCountryData(const QVector<CountryData> &data)
+    {
+        beginResetModel();
+        m_data = data;
+        endResetModel();
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override { return parent.isValid() ? 0 : m_data.size(); }
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override { return parent.isValid() ? 0 : CountryModel::COLUMNCOUNT; }
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
+    {
+        if (!index.isValid() || role != Qt::DisplayRole)
+            return QVariant();
+        const CountryData &item = m_data.at(index.row());
+        switch (index.column()) {
+        case CountryModel::Country:
+            return item.country;
+        case CountryModel::Population:
+            return item.population;
+        default:
+            break;
+        }
+        return QVariant();
+    }
+
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override
+    {
+        emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+        std::stable_sort(m_data.begin(), m_data.end(), [&](const CountryData &left, const CountryData &right) {
+            const int result = column == CountryModel::Population ? (left.population > right.population) - (left.population < right.population)
+                                                                  : left.country.compare(right.country);
+            return order == Qt::AscendingOrder ? result < 0 : result > 0;
+        });
+        emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+    }
+
+private:
+    QVector<CountryData> m_data;
+};
+
+// A copy that shares nothing with `data`, not even the strings: what a model owning its rows holds
+static QVector<CountryData> deepCopy(const QVector<CountryData> &data)
+{
+    QVector<CountryData> copy;
+    copy.reserve(data.size());
+    for (const CountryData &countryData : data)
+        copy.append({QString(countryData.country.constData(), countryData.country.size()), countryData.population});
+    return copy;
+}
+
+// The two layouts side by side, for the comparisons, sorting or reading either column, or just one of them
+static void addLayoutComparison(bool eachColumn)
+{
+    QTest::addColumn<int>("rows");
+    QTest::addColumn<bool>("records");
+    QTest::addColumn<int>("column");
+    const std::vector<int> columns = eachColumn ? std::vector<int>{CountryModel::Country, CountryModel::Population}
+                                                : std::vector<int>{CountryModel::Country};
+    for (int rows : BenchmarkResults::rowCounts()) {
+        for (int column : columns) {
+            for (bool records : {false, true}) {
+                QByteArray tag = QByteArray::number(rows) + " rows, " + (records ? "records" : "columns");
+                if (eachColumn)
+                    tag += column == CountryModel::Country ? ", by country" : ", by population";
+                QTest::newRow(tag.constData()) << rows << records << column;
+            }
+        }
+    }
+}
+
+static QString layoutName(bool records)
+{
+    return records ? QStringLiteral("CountryRecordsModel (part1, before)") : QStringLiteral("CountryModel (part1)");
+}
+
+class BenchmarkReorderWithModelView : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanupTestCase() { BenchmarkResults::write(); }
+
+    void dragAndDrop_data()
+    {
+        QTest::addColumn<int>("rows");
+        QTest::addColumn<bool>("file");
+        for (int rows : BenchmarkResults::rowCounts()) {
+            QTest::addRow("%d rows in memory", rows) << rows << false;
+            QTest::addRow("%d rows in a file", rows) << rows << true;
+        }
+    }
+
+    // Dragging 100 rows from the middle of the view and dropping them at the top, like QTreeView does it
+    // (QListView, and QTableView since Qt 6.8, call moveRows() directly)
+    void dragAndDrop()
+    {
+        QFETCH(int, rows);
+        QFETCH(bool, file);
+        CountryModel model;
+        QTemporaryDir directory;
+        if (file) {
+            const QString fileName = directory.filePath(QStringLiteral("countries"));
+            SyntheticData generator;
+            QVERIFY(MappedCountries::writeFile(fileName, rows, [&generator](qint64) {
+                return QPair<QString, int>{generator.name(), generator.skewed(1, 1500, 4.0)};
+            }));
+            QVERIFY(model.setCountryFile(fileName));
+        } else {
+            model.setCountryData(BenchmarkData::countries<CountryData>(rows));
+        }
+
+        const int firstDraggedRow = rows / 2;
+        QModelIndexList indexes; // what QTreeView passes: all the columns of the selected rows
+        for (int row = firstDraggedRow; row < firstDraggedRow + 100; ++row) {
+            for (int column = 0; column < model.columnCount(); ++column)
+                indexes.append(model.index(row, column));
+        }
+
+        BenchmarkRun run(file ? QStringLiteral("CountryModel (part1, file)") : QStringLiteral("CountryModel (part1)"), rows);
+        while (run.next()) {
+            const std::unique_ptr<QMimeData> mimeData(model.mimeData(indexes));
+            run.lap("mimeData");
+            model.dropMimeData(mimeData.get(), Qt::MoveAction, 0, 0, QModelIndex());
+            run.lap("dropMimeData");
+            // No removeRows(): dropMimeData() moved the rows already
+        }
+        QCOMPARE(model.rowCount(), rows);
+    }
+
+    void sort_data() { addLayoutComparison(true); }
+
+    // Clicking on a header section of the table view, with the columns of CountryModel and with the records
+    // it used to have. The rows are put back in their original order after each sort, which isn't timed.
+    void sort()
+    {
+        QFETCH(int, rows);
+        QFETCH(bool, records);
+        QFETCH(int, column);
+        const QVector<CountryData> data = BenchmarkData::countries<CountryData>(rows);
+        CountryModel model;
+        CountryRecordsModel recordsModel;
+        QAbstractItemModel *sortedModel = records ? static_cast<QAbstractItemModel *>(&recordsModel) : &model;
+        // Unshared, so that sorting the records doesn't start with copying them
+        const auto reset = [&] {
+            if (records)
+                recordsModel.setCountryData(deepCopy(data));
+            else
+                model.setCountryData(data);
+        };
+        reset();
+
+        BenchmarkRun run(layoutName(records), rows);
+        while (run.next()) {
+            sortedModel->sort(column, Qt::AscendingOrder);
+            run.lap("sort");
+            reset();
+        }
+        QCOMPARE(sortedModel->rowCount(), rows);
+    }
+
+    void data_data() { addLayoutComparison(true); }
+
+    // Reading one column of every row, like painting or exporting does, one row at a time
+    void data()
+    {
+        QFETCH(int, rows);
+        QFETCH(bool, records);
+        QFETCH(int, column);
+        const QVector<CountryData> data = BenchmarkData::countries<CountryData>(rows);
+        CountryModel model;
+        CountryRecordsModel recordsModel;
+        QAbstractItemModel *readModel = records ? static_cast<QAbstractItemModel *>(&recordsModel) : &model;
+        if (records)
+            recordsModel.setCountryData(deepCopy(data));
+        else
+            model.setCountryData(data);
+
+        qint64 checksum = 0; // so that the compiler can't skip the reads
+        BenchmarkRun run(layoutName(records), rows);
+        while (run.next()) {
+            checksum = 0;
+            if (column == CountryModel::Population) {
+                for (int row = 0; row < rows; ++row)
+                    checksum += readModel->index(row, column).data().toInt();
+            } else {
+                for (int row = 0; row < rows; ++row)
+                    checksum += readModel->index(row, column).data().toString().size();
+            }
+            run.lap("data");
+        }
+        QVERIFY(checksum > 0);
+    }
+
+    void memory_data() { addLayoutComparison(false); }
+
+    // The memory used by the rows: the allocatedBytes of the "load" step, in the JSON results.
+    // Neither layout grows a buffer while loading, so that's what they keep, without the malloc overhead
+    // of each allocation (and the records make one allocation per row, for the QString).
+    void memory()
+    {
+        if (!BenchmarkResults::countsAllocations())
+            QSKIP("Needs DND_COUNT_ALLOCATIONS and a release build");
+        QFETCH(int, rows);
+        QFETCH(bool, records);
+        const QVector<CountryData> data = BenchmarkData::countries<CountryData>(rows);
+
+        BenchmarkRun run(layoutName(records), rows);
+        while (run.next()) {
+            if (records) {
+                CountryRecordsModel recordsModel;
+                recordsModel.setCountryData(deepCopy(data));
+                run.lap("load");
+                QCOMPARE(recordsModel.rowCount(), rows);
+            } else {
+                CountryModel model;
+                model.setCountryData(data);
+                run.lap("load");
+                QCOMPARE(model.rowCount(), rows);
+            }
+        }
+    }
+
+    // Not a benchmark: moving rows shouldn't allocate more than a few times per row, whatever the size of the model
+    // (the QSet of row numbers allocates, the rows themselves are only rotated in place)
+    void moveAllocations()
+    {
+        if (!BenchmarkResults::countsAllocations())
+            QSKIP("Needs DND_COUNT_ALLOCATIONS and a release build");
+        CountryModel model;
+        model.setCountryData(BenchmarkData::countries<CountryData>(100000));
+        QModelIndexList indexes;
+        for (int row = 50000; row < 51000; ++row)
+            indexes.append(model.index(row, 0));
+
+        const AllocationCount before = allocationsSoFar();
+        const std::unique_ptr<QMimeData> mimeData(model.mimeData(indexes));
+        model.dropMimeData(mimeData.get(), Qt::MoveAction, 0, 0, QModelIndex()); // false: it moved the rows itself
+        const quint64 allocations = allocationsSoFar().count - before.count;
+        QVERIFY2(allocations < 3000, qPrintable(QStringLiteral("Moving 1000 rows allocated %1 times").arg(allocations)));
+    }
+};
+
+QTEST_MAIN(BenchmarkReorderWithModelView)
+
+#include "bench-reorder-with-model-view.moc"
@@ -0,0 +1,85 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+// part3's item widget examples: switching folders, which fills the emails widget with the emails of the folder,
+// reusing the items of the previous folder. Built once per example, see CMakeLists.txt.
+#if defined(DND_BENCHMARK_QLISTWIDGET)
+#include "../part3-dropping-onto-items/qlistwidget/drop-onto-qlistwidgetitems.cpp"
+using EmailsWidget = EmailsListWidget;
+static const char s_widgetName[] = "EmailsListWidget (part3)";
+#elif defined(DND_BENCHMARK_QTABLEWIDGET)
+#include "../part3-dropping-onto-items/qtablewidget/drop-onto-qtablewidgetitems.cpp"
+using EmailsWidget = EmailsTableWidget;
+static const char s_widgetName[] = "EmailsTableWidget (part3)";
+#elif defined(DND_BENCHMARK_QTREEWIDGET)
+#include "../part3-dropping-onto-items/qtreewidget/drop-onto-qtreewidgetitems.cpp"
+using EmailsWidget = EmailsTreeWidget;
+static const char s_widgetName[] = "EmailsTreeWidget (part3)";
+#else
+#error "Define which example to benchmark"
+#endif
+
+#include "benchmark-results.h"
+
+#include <QTest>
+
+class BenchmarkSwitchFoldersWithItemWidgets : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanupTestCase() { BenchmarkResults::write(); }
+
+    void switchFolders_data()
+    {
+        QTest::addColumn<int>("rows");
+        QTest::addColumn<int>("otherRows");
+        for (int rows : BenchmarkResults::rowCounts(1000, 1000000)) {
+            QTest::addRow("%d and %d emails", rows, rows) << rows << rows;
+            QTest::addRow("%d and %d emails", rows, rows / 10) << rows << rows / 10;
+        }
+    }
+
+    // Clicking on a folder, then on another one, and so on: the time until the emails widget shows the new folder.
+    // With folders of the same size, all the items are reused; otherwise, the difference is removed or inserted.
+    void switchFolders()
+    {
+        QFETCH(int, rows);
+        QFETCH(int, otherRows);
+        SyntheticData generator;
+        EmailFolder folders[2];
+        const int emailCounts[2] = {rows, otherRows};
+        for (int i = 0; i < 2; ++i) {
+            folders[i].folderName = generator.name();
+            folders[i].emails.reserve(emailCounts[i]);
+            for (int email = 0; email < emailCounts[i]; ++email)
+                folders[i].emails.append(generator.sentence(2, 6));
+        }
+
+        EmailsWidget emailsWidget;
+        emailsWidget.fillEmailsList(folders[0]);
+        emailsWidget.resize(700, 800);
+        emailsWidget.show();
+        QVERIFY(QTest::qWaitForWindowExposed(&emailsWidget));
+
+        int switches = 0;
+        BenchmarkRun run(QLatin1String(s_widgetName), rows);
+        while (run.next()) {
+            emailsWidget.fillEmailsList(folders[++switches % 2]);
+            run.lap("fillEmailsList");
+            emailsWidget.viewport()->repaint(); // the posted layout happens there
+            run.lap("paint");
+        }
+        run.setValue(QStringLiteral("otherRows"), otherRows);
+        const EmailFolder &shownFolder = folders[switches % 2];
+        QCOMPARE(emailsWidget.model()->rowCount(), int(shownFolder.emails.size()));
+        QCOMPARE(emailsWidget.model()->index(0, 0).data().toString(), shownFolder.emails.first());
+    }
+};
+
+QTEST_MAIN(BenchmarkSwitchFoldersWithItemWidgets)
+
+#include "bench-switch-folders-with-item-widgets.moc"
@@ -0,0 +1,45 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+#pragma once
+
+#include "synthetic-data.h"
+
+#include <QString>
+#include <QVector>
+
+// The data the benchmarks run with: like the data generated by the examples' command line options,
+// but with an exact number of rows, so that the results for different sizes can be compared.
+class BenchmarkData
+{
+public:
+    // The same rows as the examples' --rows option. CountryData differs between the examples, hence the template.
+    template<typename CountryData>
+    static QVector<CountryData> countries(int rows, quint32 seed = 1)
+    {
+        SyntheticData generator(seed);
+        QVector<CountryData> data;
+        data.reserve(rows);
+        for (int row = 0; row < rows; ++row)
+            data.append({generator.name(), generator.skewed(1, 1500, 4.0)}); // mostly small countries
+        return data;
+    }
+
+    // A tree with exactly `nodes` nodes, in the text format of the treemodel examples: top-level nodes with
+    // treeFanout - 1 children each, so that the number of children doesn't depend on the size of the tree
+    static constexpr int treeFanout = 100;
+    static QString treeText(int nodes, quint32 seed = 1)
+    {
+        SyntheticData generator(seed);
+        QString text;
+        for (int node = 0; node < nodes; ++node) {
+            if (node % treeFanout != 0)
+                text += QLatin1String("    ");
+            text += generator.name() + QLatin1Char('\t') + generator.sentence(3, 8) + QLatin1Char('\n');
+        }
+        return text;
+    }
+};
@@ -0,0 +1,230 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+#pragma once
+
+#include "model-instrumentation.h" // for allocationsSoFar()
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTest>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// What the benchmarks have in common: the row counts they run with, timing the steps of an operation (and counting
+// their heap allocations, see allocation-counter.cpp), and writing the results as JSON, for tracking regressions
+// (QtTest itself has no JSON output).
+//
+// Environment variables:
+//   DND_BENCHMARK_MAX_ROWS: the biggest row count to run with (default: 100000). The benchmarks go up to 10M rows,
+//   which takes a while and a few GB of memory, e.g. DND_BENCHMARK_MAX_ROWS=10000000 ctest -V
+//   DND_BENCHMARK_RESULTS: the directory to write the results to (default: the current directory), one file per
+//   benchmark executable, e.g. BenchmarkReorderWithModelView.json
+class BenchmarkResults
+{
+public:
+    static int maxRowCount()
+    {
+        bool ok = false;
+        const int maxRows = qEnvironmentVariableIntValue("DND_BENCHMARK_MAX_ROWS", &ok);
+        return ok ? maxRows : 100000;
+    }
+
+    // From minRows to maxRows, times 10 each time, up to maxRowCount()
+    static std::vector<int> rowCounts(int minRows = 1000, int maxRows = 10000000)
+    {
+        std::vector<int> result;
+        const int limit = std::min(maxRows, maxRowCount());
+        for (qint64 rows = minRows; rows <= limit; rows *= 10)
+            result.push_back(int(rows));
+        return result;
+    }
+
+    // For the _data() functions: one row of test data per row count
+    static void addRowCounts(int minRows = 1000, int maxRows = 10000000)
+    {
+        QTest::addColumn<int>("rows");
+        for (int rows : rowCounts(minRows, maxRows))
+            QTest::addRow("%d", rows) << rows;
+    }
+
+    static void record(const QJsonObject &result) { results().append(result); }
+
+    // Whether the allocation counts mean something: built with allocation-counter.cpp, and without
+    // the QAbstractItemModelTester of the models, which allocates a lot (QT_NO_DEBUG)
+    static bool countsAllocations()
+    {
+#if defined(DND_COUNT_ALLOCATIONS) && defined(QT_NO_DEBUG)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // To be called from cleanupTestCase()
+    static void write()
+    {
+        const QString directory = qEnvironmentVariable("DND_BENCHMARK_RESULTS", QDir::currentPath());
+        QFile file(directory + '/' + QCoreApplication::applicationName() + QLatin1String(".json"));
+        if (!file.open(QIODevice::WriteOnly)) {
+            qWarning() << "Could not write" << file.fileName() << file.errorString();
+            return;
+        }
+        const QJsonObject document{
+            {"benchmark", QCoreApplication::applicationName()},
+            {"qtVersion", QLatin1String(qVersion())},
+            {"cpu", QSysInfo::currentCpuArchitecture()},
+            {"results", results()},
+        };
+        file.write(QJsonDocument(document).toJson());
+    }
+
+private:
+    static QJsonArray &results()
+    {
+        static QJsonArray s_results;
+        return s_results;
+    }
+};
+
+// Times the steps of an operation, e.g. mimeData, dropMimeData and removeRows for a drag and drop, running
+// it several times and keeping the median of each step. Only what happens between next() and the last lap()
+// of each iteration is timed, so the end of the loop body can undo the operation for the next iteration:
+//
+//   BenchmarkRun run("CountryModel", rows);
+//   while (run.next()) {
+//       std::unique_ptr<QMimeData> mimeData(model.mimeData(indexes));
+//       run.lap("mimeData");
+//       ...
+//       run.lap("removeRows");
+//       // undo, not timed
+//   }
+//
+// When done, the medians are recorded in the JSON results, and their sum as the QtTest benchmark result.
+// The JSON results have the median number of heap allocations of each step as well, and the bytes allocated.
+class BenchmarkRun
+{
+public:
+    BenchmarkRun(const QString &model, int rows)
+        : m_model(model)
+        , m_rows(rows)
+    {
+    }
+
+    ~BenchmarkRun() { finish(); }
+
+    // At least 3 iterations, and then as many as fit in 100 ms, up to 1000. The big sizes stop after 5 s.
+    bool next()
+    {
+        if (m_totalTimer.isValid()) {
+            ++m_iterations;
+            const qint64 elapsed = m_totalTimer.elapsed();
+            if ((m_iterations >= 3 && elapsed >= 100) || m_iterations >= 1000 || elapsed >= 5000)
+                return false;
+        } else {
+            m_totalTimer.start();
+        }
+        m_lapAllocations = allocationsSoFar();
+        m_lapTimer.start();
+        return true;
+    }
+
+    void lap(const char *step)
+    {
+        const qint64 nsecs = m_lapTimer.nsecsElapsed();
+        const AllocationCount allocations = allocationsSoFar();
+        Samples &samples = m_samples[step];
+        samples.nsecs.push_back(nsecs);
+        samples.allocations.push_back(allocations.count - m_lapAllocations.count);
+        samples.allocatedBytes.push_back(allocations.bytes - m_lapAllocations.bytes);
+        if (std::find(m_steps.cbegin(), m_steps.cend(), step) == m_steps.cend())
+            m_steps.push_back(step);
+        // Not counting the bookkeeping above
+        m_lapAllocations = allocationsSoFar();
+        m_lapTimer.start();
+    }
+
+    // Something else to report for this run, e.g. the number of signals emitted
+    void setValue(const QString &key, double value) { m_values.insert(key, value); }
+
+private:
+    void finish()
+    {
+        if (m_steps.empty())
+            return; // e.g. the test failed before the first lap
+        qint64 totalNsecs = 0;
+        quint64 totalAllocations = 0;
+        quint64 totalAllocatedBytes = 0;
+        QJsonObject steps;
+        for (const char *step : m_steps) {
+            Samples &samples = m_samples[step];
+            const qint64 median = BenchmarkRun::median(samples.nsecs);
+            const qint64 min = *std::min_element(samples.nsecs.cbegin(), samples.nsecs.cend());
+            QJsonObject stepResult{{"medianNsecs", double(median)}, {"minNsecs", double(min)}};
+            totalNsecs += median;
+            if (BenchmarkResults::countsAllocations()) {
+                const quint64 allocations = BenchmarkRun::median(samples.allocations);
+                const quint64 allocatedBytes = BenchmarkRun::median(samples.allocatedBytes);
+                stepResult.insert(QLatin1String("allocations"), double(allocations));
+                stepResult.insert(QLatin1String("allocatedBytes"), double(allocatedBytes));
+                totalAllocations += allocations;
+                totalAllocatedBytes += allocatedBytes;
+            }
+            steps.insert(QLatin1String(step), stepResult);
+        }
+        QJsonObject result{
+            {"test", QLatin1String(QTest::currentTestFunction())},
+            {"dataTag", QLatin1String(QTest::currentDataTag())},
+            {"model", m_model},
+            {"rows", m_rows},
+            {"iterations", m_iterations},
+            {"steps", steps},
+            {"medianNsecs", double(totalNsecs)},
+        };
+        if (BenchmarkResults::countsAllocations()) {
+            result.insert(QLatin1String("allocations"), double(totalAllocations));
+            result.insert(QLatin1String("allocatedBytes"), double(totalAllocatedBytes));
+        }
+        for (auto it = m_values.cbegin(); it != m_values.cend(); ++it)
+            result.insert(it.key(), it.value());
+        BenchmarkResults::record(result);
+        QTest::setBenchmarkResult(totalNsecs, QTest::WalltimeNanoseconds);
+    }
+
+    template<typename T>
+    static T median(std::vector<T> &samples)
+    {
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        return samples.at(samples.size() / 2);
+    }
+
+    struct Samples
+    {
+        std::vector<qint64> nsecs;
+        std::vector<quint64> allocations;
+        std::vector<quint64> allocatedBytes;
+    };
+
+    const QString m_model;
+    const int m_rows;
+    int m_iterations = 0;
+    QElapsedTimer m_totalTimer;
+    QElapsedTimer m_lapTimer;
+    AllocationCount m_lapAllocations = {0, 0};
+    std::vector<const char *> m_steps; // in the order of the first iteration
+    // Keyed by pointer rather than by string, the names are all string literals
+    std::map<const char *, Samples> m_samples;
+    QJsonObject m_values;
+};
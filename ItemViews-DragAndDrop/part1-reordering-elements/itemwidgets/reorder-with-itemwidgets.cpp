@@ -6,14 +6,21 @@
 */
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDebug>
 #include <QDialogButtonBox>
+#include <QDropEvent>
 #include <QListWidget>
+#include <QSignalBlocker>
 #include <QTableWidget>
 #include <QTreeWidget>
 #include <QVBoxLayout>
 #include <QVector>
 #include <QWidget>
+#include "synthetic-data.h"
+
+#include <algorithm>
+#include <vector>
 
 struct CountryData
 {
@@ -45,31 +52,261 @@ private:
     QVBoxLayout *m_layout;
 };
 
-#if QT_VERSION < QT_VERSION_CHECK(6, 8, 0)
-// QTableWidget::dropEvent implements InternalMove by moving data into cells (like Excel), not with insertion/removal
-// So we want the default implementation from QAbstractItemView::dropEvent instead:
-// it calls QTableWidget::dropMimeData which does the insertion, and setDragDropOverwriteMode(false) takes care of the removal after QDrag::exec() returns
-// BUG: it loses header items though
+// Before Qt 6.8, QTableWidget::dropEvent implements InternalMove by moving data into cells (like Excel), not by moving rows.
+// The default implementation from QAbstractItemView::dropEvent would serialize all the dragged items, call
+// QTableWidget::dropMimeData to insert new rows, and setDragDropOverwriteMode(false) would take care of removing
+// the old rows after QDrag::exec() returns. That's slow for big tables (every cell is re-created), and it loses header items.
+// I fixed this in Qt itself: https://codereview.qt-project.org/c/qt/qtbase/+/582308 and https://codereview.qt-project.org/c/qt/qtbase/+/581090
 //
-// I fixed this bug in Qt itself: https://codereview.qt-project.org/c/qt/qtbase/+/582308 and https://codereview.qt-project.org/c/qt/qtbase/+/581090
-
+// Since Qt 6.8, QTableWidget's model implements moveRows(), which moves the existing items and emits rowsMoved():
+// the selected rows are moved with it, one run of consecutive rows at a time.
+// Before Qt 6.8, QTableWidget has no API for moving rows, so the items of the rows between the source and the destination
+// (including the vertical header items) are taken out and put back in their new order, with the model's signals blocked,
+// and announced as a layout change. That relies on QTableWidget's internals, hence only for older Qt versions.
+// Either way, nothing is re-created, and the rows outside of that range aren't touched.
 class ReorderableTableWidget : public QTableWidget
 {
 public:
     using QTableWidget::QTableWidget;
 
 protected:
-    void dropEvent(QDropEvent *event) override { QAbstractItemView::dropEvent(event); }
-};
+    void dropEvent(QDropEvent *event) override
+    {
+        if (event->source() == this && (event->possibleActions() & Qt::MoveAction)) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+            const QModelIndex index = indexAt(event->position().toPoint());
+#else
+            const QModelIndex index = indexAt(event->pos());
+#endif
+            int destinationRow = rowCount(); // dropping below the last row
+            if (index.isValid())
+                destinationRow = dropIndicatorPosition() == BelowItem ? index.row() + 1 : index.row();
+            moveSelectedRows(destinationRow);
+            event->accept();
+            // We moved the rows already, don't let QAbstractItemView::startDrag remove the source rows.
+            // Qt does the same with its private dropEventMoved flag, which we can't set from here.
+            // Reporting a copy instead of a move is safe because the drag source is always this view (see the check
+            // above): with InternalMove, drags from other widgets or applications are ignored in dragEnterEvent,
+            // so no other drag source ever sees this drop action.
+            event->setDropAction(Qt::CopyAction);
+        } else {
+            event->ignore();
+        }
+        // What QAbstractItemView::dropEvent does at the end
+        stopAutoScroll();
+        setState(NoState);
+        viewport()->update();
+    }
+
+private:
+#if QT_VERSION < QT_VERSION_CHECK(6, 8, 0)
+    // changePersistentIndexList() and persistentIndexList() are protected; naming them through a subclass makes
+    // them accessible, and the member function pointers can then be called on QTableWidget's model.
+    struct ModelAccess : QAbstractItemModel
+    {
+        using QAbstractItemModel::changePersistentIndexList;
+        using QAbstractItemModel::persistentIndexList;
+    };
+#endif
+
+    void moveSelectedRows(int destinationRow)
+    {
+        std::vector<int> movedRows;
+        const QModelIndexList selectedIndexes = selectionModel()->selectedIndexes();
+        for (const QModelIndex &index : selectedIndexes)
+            movedRows.push_back(index.row());
+        std::sort(movedRows.begin(), movedRows.end());
+        movedRows.erase(std::unique(movedRows.begin(), movedRows.end()), movedRows.end());
+        if (movedRows.empty())
+            return;
+        // The moved rows end up together, starting where the first one lands
+        const int movedAbove = int(std::lower_bound(movedRows.begin(), movedRows.end(), destinationRow) - movedRows.begin());
+        const int newFirstMovedRow = destinationRow - movedAbove;
+        QAbstractItemModel *model = this->model();
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 8, 0)
+        // The runs above the destination, from the last one, each to just before the previous one;
+        // then the runs below it, from the first one, each to just after the previous one.
+        // Moving a run doesn't change the rows of the runs still to be moved.
+        std::vector<std::pair<int, int>> runs; // first row, count
+        for (int row : movedRows) {
+            if (!runs.empty() && runs.back().first + runs.back().second == row && row != destinationRow)
+                ++runs.back().second;
+            else
+                runs.emplace_back(row, 1);
+        }
+        int upperDestination = destinationRow;
+        for (auto it = runs.crbegin(); it != runs.crend(); ++it) {
+            if (it->first >= destinationRow)
+                continue;
+            model->moveRows(QModelIndex(), it->first, it->second, QModelIndex(), upperDestination); // false if a no-op
+            upperDestination -= it->second;
+        }
+        int lowerDestination = destinationRow;
+        for (const auto &run : runs) {
+            if (run.first < destinationRow)
+                continue;
+            model->moveRows(QModelIndex(), run.first, run.second, QModelIndex(), lowerDestination);
+            lowerDestination += run.second;
+        }
+        const int columns = columnCount();
+#else
+        // Only the rows in [firstRow, lastRow) change
+        const int firstRow = std::min(movedRows.front(), destinationRow);
+        const int lastRow = std::max(movedRows.back() + 1, destinationRow);
+        const auto isMoved = [&](int row) { return std::binary_search(movedRows.begin(), movedRows.end(), row); };
+        std::vector<int> newOrder; // the old row of each row in the range
+        newOrder.reserve(lastRow - firstRow);
+        for (int row = firstRow; row < destinationRow; ++row) {
+            if (!isMoved(row))
+                newOrder.push_back(row);
+        }
+        Q_ASSERT(newFirstMovedRow == firstRow + int(newOrder.size()));
+        newOrder.insert(newOrder.end(), movedRows.begin(), movedRows.end());
+        for (int row = destinationRow; row < lastRow; ++row) {
+            if (!isMoved(row))
+                newOrder.push_back(row);
+        }
+
+        // Dropping the rows where they already are?
+        bool unchanged = true;
+        for (int i = 0; i < int(newOrder.size()) && unchanged; ++i)
+            unchanged = newOrder.at(i) == firstRow + i;
+        if (unchanged)
+            return;
+
+        // Each takeItem() and setItem() call would emit dataChanged (and headerDataChanged for the header items),
+        // and the selection would be updated for each of them: instead, the model's signals are blocked, and the
+        // whole move is announced as one layout change, with the persistent indexes (selection, current index,
+        // editors...) moved to the new rows.
+        emit model->layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+        std::vector<int> newRows(newOrder.size()); // the new row of each old row in the range
+        for (int i = 0; i < int(newOrder.size()); ++i)
+            newRows[newOrder.at(i) - firstRow] = firstRow + i;
+        const QModelIndexList persistentIndexes = (model->*(&ModelAccess::persistentIndexList))();
+        QModelIndexList newPersistentIndexes;
+        newPersistentIndexes.reserve(persistentIndexes.size());
+        for (const QModelIndex &index : persistentIndexes) {
+            const int row = index.row();
+            const bool inRange = row >= firstRow && row < lastRow;
+            newPersistentIndexes.append(inRange ? model->index(newRows.at(row - firstRow), index.column()) : index);
+        }
+
+        const int columns = columnCount();
+        std::vector<QTableWidgetItem *> items;
+        std::vector<QTableWidgetItem *> headerItems;
+        items.reserve(newOrder.size() * columns);
+        headerItems.reserve(newOrder.size());
+        {
+            const QSignalBlocker blocker(model);
+            for (int row = firstRow; row < lastRow; ++row) {
+                for (int column = 0; column < columns; ++column)
+                    items.push_back(takeItem(row, column));
+                headerItems.push_back(takeVerticalHeaderItem(row));
+            }
+            for (int i = 0; i < int(newOrder.size()); ++i) {
+                const int oldOffset = newOrder.at(i) - firstRow;
+                for (int column = 0; column < columns; ++column) {
+                    if (QTableWidgetItem *item = items.at(oldOffset * columns + column))
+                        setItem(firstRow + i, column, item);
+                }
+                if (QTableWidgetItem *headerItem = headerItems.at(oldOffset))
+                    setVerticalHeaderItem(firstRow + i, headerItem);
+            }
+        }
+        (model->*(&ModelAccess::changePersistentIndexList))(persistentIndexes, newPersistentIndexes);
+        emit model->layoutChanged({}, QAbstractItemModel::VerticalSortHint);
 #endif
 
+        // Keep the moved rows selected, as a single range
+        const QItemSelection selection(model->index(newFirstMovedRow, 0),
+                                       model->index(newFirstMovedRow + int(movedRows.size()) - 1, columns - 1));
+        selectionModel()->select(selection, QItemSelectionModel::ClearAndSelect);
+        selectionModel()->setCurrentIndex(model->index(newFirstMovedRow, 0), QItemSelectionModel::NoUpdate);
+    }
+};
+
+// Bulk loading: all the items are created first, and then inserted at once, so that each widget
+// is notified once rather than once per row (or per cell), which matters with many rows.
+static void populateListWidget(QListWidget *listWidget, const QVector<CountryData> &data)
+{
+    QStringList countries;
+    countries.reserve(data.count());
+    for (const CountryData &countryData : data)
+        countries.append(countryData.country);
+    listWidget->addItems(countries); // a single row insertion
+}
+
+template<typename SetupItem>
+static void populateTableWidget(QTableWidget *tableWidget, const QVector<CountryData> &data, SetupItem setupItem)
+{
+    tableWidget->setRowCount(data.count()); // a single row insertion
+    // QTableWidget has no API for setting many items at once, and each setItem() call notifies the view.
+    // So we set the items with the model's signals blocked, and then tell the view that everything changed.
+    // This is OK because the rows exist already, only their contents are unknown to the view.
+    // Limitation: this relies on how QTableWidget's private model reacts to setItem(). With sorting enabled,
+    // setItem() also moves the row to its sorted position, and the layout change notifying the view and updating
+    // the persistent indexes would be blocked too: sort once after populating instead.
+    // The rows aren't given vertical header items, the view numbers them itself, which costs nothing per row:
+    // the row labels are "1", "2"... rather than "Country 1", "Country 2"... as they used to be.
+    Q_ASSERT(!tableWidget->isSortingEnabled());
+    QAbstractItemModel *model = tableWidget->model();
+    {
+        const QSignalBlocker blocker(model);
+        for (int row = 0; row < data.count(); ++row) {
+            const CountryData &countryData = data.at(row);
+            auto countryItem = new QTableWidgetItem(countryData.country);
+            setupItem(countryItem);
+            tableWidget->setItem(row, 0, countryItem);
+            auto populationItem = new QTableWidgetItem;
+            setupItem(populationItem);
+            populationItem->setData(Qt::DisplayRole, countryData.population);
+            tableWidget->setItem(row, 1, populationItem);
+        }
+    }
+    if (!data.isEmpty())
+        emit model->dataChanged(model->index(0, 0), model->index(data.count() - 1, model->columnCount() - 1));
+}
+
+template<typename SetupItem>
+static void populateTreeWidget(QTreeWidget *treeWidget, const QVector<CountryData> &data, SetupItem setupItem)
+{
+    QList<QTreeWidgetItem *> items;
+    items.reserve(data.count());
+    for (const CountryData &countryData : data) {
+        auto item = new QTreeWidgetItem;
+        item->setData(0, Qt::DisplayRole, countryData.country);
+        item->setData(1, Qt::DisplayRole, countryData.population);
+        setupItem(item);
+        items.append(item);
+    }
+    treeWidget->addTopLevelItems(items); // a single row insertion
+}
+
+// The benchmarks include this file, with their own main()
+#ifndef DND_BENCHMARK
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("view", "list (default), table or tree", "[view]");
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.rows, syntheticDataOptions.seed});
+    parser.process(app);
+
     QVector<CountryData> data = {
         {"USA", 331}, {"China", 1439}, {"India", 1380}, {"Brazil", 213}, {"France", 67},
     };
+    if (parser.isSet(syntheticDataOptions.rows)) {
+        SyntheticData generator(SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+        const int rowCount = SyntheticDataOptions::intValue(parser, syntheticDataOptions.rows);
+        data.clear();
+        data.reserve(rowCount);
+        for (int row = 0; row < rowCount; ++row)
+            data.append({generator.name(), generator.skewed(1, 1500, 4.0)}); // mostly small countries
+    }
 
     // DND CODE START
 
@@ -93,29 +330,18 @@ int main(int argc, char *argv[])
 
         // We don't want Excel-like overwriting of data on drop, we want to move rows
         tableWidget->setDragDropOverwriteMode(false);
-
-#if QT_VERSION < QT_VERSION_CHECK(6, 8, 0)
-        auto prototype = new QTableWidgetItem;
-        setupTableItem(prototype);
-        // After a drop, QTableWidget creates new items, ensure they don't support dropping onto them
-        tableWidget->setItemPrototype(prototype); // takes ownership
-#endif
     };
 
     // DND CODE END
 
     auto topLevel = new TopLevelWidget(nullptr);
-    const auto args = QCoreApplication::arguments();
-    const QString viewType = args.size() > 1 ? args.at(1) : "list";
+    const QString viewType = parser.positionalArguments().value(0, "list");
     if (viewType == "list") {
         auto listWidget = new QListWidget;
         topLevel->setView(listWidget);
         topLevel->setWindowTitle("Reorderable QListWidget");
 
-        for (const CountryData &countryData : data) {
-            QListWidgetItem *item = new QListWidgetItem(countryData.country);
-            listWidget->addItem(item);
-        }
+        populateListWidget(listWidget, data);
 
         QObject::connect(topLevel, &TopLevelWidget::okClicked, [&]() {
             // Use the new order - here we just print it out
@@ -127,33 +353,12 @@ int main(int argc, char *argv[])
         setupWidgetForReorderingDnD(listWidget);
 
     } else if (viewType == "table") {
-#if QT_VERSION >= QT_VERSION_CHECK(6, 8, 0)
-        qDebug() << "using upstream QTableWidget";
-        auto tableWidget = new QTableWidget;
-#else
-        qDebug() << "using hackish ReorderableTableWidget";
         auto tableWidget = new ReorderableTableWidget;
-#endif
         topLevel->setView(tableWidget);
         topLevel->setWindowTitle("Reorderable QTableWidget");
-        tableWidget->setRowCount(data.count());
         tableWidget->setColumnCount(2);
         tableWidget->setHorizontalHeaderLabels({"Country", "Population (millions)"});
-
-        for (int row = 0; row < data.count(); ++row) {
-            const CountryData &countryData = data.at(row);
-            auto countryItem = new QTableWidgetItem(countryData.country);
-            setupTableItem(countryItem);
-            tableWidget->setItem(row, 0, countryItem);
-            auto populationItem = new QTableWidgetItem;
-            setupTableItem(populationItem);
-            populationItem->setData(Qt::DisplayRole, countryData.population);
-            tableWidget->setItem(row, 1, populationItem);
-
-            auto headerItem = new QTableWidgetItem();
-            headerItem->setText(QStringLiteral("Country %1").arg(row + 1));
-            tableWidget->setVerticalHeaderItem(row, headerItem);
-        }
+        populateTableWidget(tableWidget, data, setupTableItem);
         setupTableWidgetForReorderingDnD(tableWidget);
 
         QObject::connect(topLevel, &TopLevelWidget::okClicked, [&]() {
@@ -170,13 +375,7 @@ int main(int argc, char *argv[])
         treeWidget->setColumnCount(2);
         treeWidget->setHeaderLabels({"Country", "Population (millions)"});
 
-        for (const CountryData &countryData : data) {
-            auto item = new QTreeWidgetItem;
-            item->setData(0, Qt::DisplayRole, countryData.country);
-            item->setData(1, Qt::DisplayRole, countryData.population);
-            setupTreeItem(item);
-            treeWidget->addTopLevelItem(item);
-        }
+        populateTreeWidget(treeWidget, data, setupTreeItem);
 
         setupWidgetForReorderingDnD(treeWidget);
 
@@ -197,5 +396,6 @@ int main(int argc, char *argv[])
 
     return app.exec();
 }
+#endif
 
 #include "reorder-with-itemwidgets.moc"
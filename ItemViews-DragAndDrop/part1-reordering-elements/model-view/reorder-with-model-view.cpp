@@ -8,6 +8,7 @@
 #include <QAbstractItemModelTester>
 #include <QAbstractTableModel>
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDebug>
 #include <QHeaderView>
 #include <QIODevice>
@@ -18,6 +19,13 @@
 #include <QVector>
 #include <QWidget>
 #include "check-index.h"
+#include "mapped-countries.h"
+#include "model-instrumentation.h"
+#include "synthetic-data.h"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
 
 struct CountryData
 {
@@ -25,6 +33,120 @@ struct CountryData
     int population; // in millions
 };
 
+// Column-oriented ("structure of arrays") storage for the country table.
+// Each column is a contiguous array, so that scanning a single column (painting, sorting
+// by population, moving a block of rows) only touches the memory of that column.
+// The country names are stored back to back in a single string pool, each row only has
+// an offset and a length into it: no per-row heap allocation, no per-row QString header.
+class CountryColumns
+{
+public:
+    void assign(const QVector<CountryData> &data)
+    {
+        m_namePool.clear();
+        m_nameOffsets.clear();
+        m_nameLengths.clear();
+        m_populations.clear();
+        // One allocation for the pool, rather than growing it row by row
+        qsizetype poolSize = 0;
+        for (const CountryData &countryData : data)
+            poolSize += countryData.country.size();
+        m_namePool.reserve(poolSize);
+        m_nameOffsets.reserve(data.size());
+        m_nameLengths.reserve(data.size());
+        m_populations.reserve(data.size());
+        for (const CountryData &countryData : data) {
+            m_nameOffsets.append(m_namePool.size());
+            m_nameLengths.append(countryData.country.size());
+            m_namePool += countryData.country;
+            m_populations.append(countryData.population);
+        }
+    }
+
+    int size() const { return m_populations.size(); }
+
+    QStringView countryView(int row) const
+    {
+        return QStringView(m_namePool).mid(m_nameOffsets.at(row), m_nameLengths.at(row));
+    }
+    // Note: this allocates a new QString, the pool is never shared with the caller
+    QString country(int row) const { return countryView(row).toString(); }
+    int population(int row) const { return m_populations.at(row); }
+
+    // Moves the rows [sourceRow, sourceRow + count) so that they end up in front of
+    // destinationChild (numbered before the move, like in beginMoveRows()).
+    // The name pool itself doesn't change, only the offset table does.
+    void moveRows(int sourceRow, int count, int destinationChild)
+    {
+        const auto moveBlock = [&](auto &column) {
+            const auto begin = column.begin();
+            if (destinationChild > sourceRow)
+                std::rotate(begin + sourceRow, begin + sourceRow + count, begin + destinationChild);
+            else
+                std::rotate(begin + destinationChild, begin + sourceRow, begin + sourceRow + count);
+        };
+        moveBlock(m_nameOffsets);
+        moveBlock(m_nameLengths);
+        moveBlock(m_populations);
+    }
+
+    // The order in which the rows should appear when sorted by population, i.e. result[newRow] == oldRow
+    QVector<int> populationSortPermutation(Qt::SortOrder order) const
+    {
+        const int count = size();
+        QVector<int> permutation(count);
+        // Sort plain 64-bit integer keys rather than calling a comparator on rows:
+        // the population (with the sign bit flipped so that unsigned ordering works,
+        // and inverted for descending order) is in the high bits, the row number in the
+        // low bits, which keeps the sort stable. The compiler can vectorize the key
+        // building, and the sort itself only compares integers in a contiguous array.
+        std::vector<quint64> keys(count);
+        for (int row = 0; row < count; ++row) {
+            quint32 key = quint32(m_populations.at(row)) ^ 0x80000000u;
+            if (order == Qt::DescendingOrder)
+                key = ~key;
+            keys[row] = (quint64(key) << 32) | quint32(row);
+        }
+        std::sort(keys.begin(), keys.end());
+        for (int i = 0; i < count; ++i)
+            permutation[i] = int(keys[i] & 0xffffffffu);
+        return permutation;
+    }
+
+    // The same, sorted by country name
+    QVector<int> countrySortPermutation(Qt::SortOrder order) const
+    {
+        QVector<int> permutation(size());
+        std::iota(permutation.begin(), permutation.end(), 0);
+        std::stable_sort(permutation.begin(), permutation.end(), [&](int left, int right) {
+            const int result = countryView(left).compare(countryView(right));
+            return order == Qt::AscendingOrder ? result < 0 : result > 0;
+        });
+        return permutation;
+    }
+
+    // Reorders all columns so that the new row i is the old row permutation[i]
+    void permute(const QVector<int> &permutation)
+    {
+        const auto permuteColumn = [&](QVector<int> &column) {
+            QVector<int> newColumn;
+            newColumn.reserve(column.size());
+            for (int oldRow : permutation)
+                newColumn.append(column.at(oldRow));
+            column.swap(newColumn);
+        };
+        permuteColumn(m_nameOffsets);
+        permuteColumn(m_nameLengths);
+        permuteColumn(m_populations);
+    }
+
+private:
+    QString m_namePool;
+    QVector<int> m_nameOffsets;
+    QVector<int> m_nameLengths;
+    QVector<int> m_populations;
+};
+
 static const char s_mimeType[] = "application/x-countrydata-rownumber";
 
 class CountryModel : public QAbstractTableModel
@@ -47,16 +169,28 @@ public:
     void setCountryData(const QVector<CountryData> &data)
     {
         beginResetModel();
-        m_data = data;
+        m_mappedCountries.close();
+        m_columns.assign(data);
         endResetModel();
     }
 
+    // Alternatively, show the records of a countries file (see MappedCountries for the format).
+    // This is O(1), whatever the size of the file: the records are only read when displayed.
+    bool setCountryFile(const QString &fileName)
+    {
+        beginResetModel();
+        m_columns.assign({});
+        const bool ok = m_mappedCountries.open(fileName);
+        endResetModel();
+        return ok;
+    }
+
     int rowCount(const QModelIndex &parent = QModelIndex()) const override
     {
         CHECK_rowCount(parent);
         if (parent.isValid())
             return 0; // flat model
-        return m_data.size();
+        return m_mappedCountries.isOpen() ? m_mappedCountries.size() : m_columns.size();
     }
 
     int columnCount(const QModelIndex &parent = QModelIndex()) const override
@@ -72,12 +206,12 @@ public:
         if (!index.isValid() || role != Qt::DisplayRole)
             return QVariant();
 
-        const CountryData &item = m_data.at(index.row());
+        const int row = index.row();
         switch (index.column()) {
         case Columns::Country:
-            return item.country;
+            return m_mappedCountries.isOpen() ? m_mappedCountries.country(row) : m_columns.country(row);
         case Columns::Population:
-            return item.population;
+            return m_mappedCountries.isOpen() ? m_mappedCountries.population(row) : m_columns.population(row);
         default:
             break;
         }
@@ -191,33 +325,94 @@ public:
         if (!beginMoveRows(sourceParent, sourceRow, sourceRow + count - 1, destinationParent, destinationChild))
             return false; // invalid move, e.g. no-op (move row 2 to row 2, or move row 2 to row 3)
 
-        for (int i = 0; i < count; ++i) {
-            m_data.move(sourceRow + i, destinationChild + (sourceRow > destinationChild ? 0 : -1));
-        }
+        if (m_mappedCountries.isOpen())
+            m_mappedCountries.moveRows(sourceRow, count, destinationChild); // O(number of moves so far), not O(rows)
+        else
+            m_columns.moveRows(sourceRow, count, destinationChild);
 
         endMoveRows();
         return true;
     }
 
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override
+    {
+        if (column < 0 || column >= COLUMNCOUNT)
+            return;
+        // Not supported for files: that would mean reading every record and storing a full permutation
+        if (m_mappedCountries.isOpen())
+            return;
+        emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+        const QVector<int> permutation =
+            column == Population ? m_columns.populationSortPermutation(order) : m_columns.countrySortPermutation(order);
+        m_columns.permute(permutation);
+
+        // Update persistent indexes (selection, current index) to follow their rows
+        QVector<int> newRowForOldRow(permutation.size());
+        for (int newRow = 0; newRow < permutation.size(); ++newRow)
+            newRowForOldRow[permutation.at(newRow)] = newRow;
+        const QModelIndexList oldIndexes = persistentIndexList();
+        QModelIndexList newIndexes;
+        newIndexes.reserve(oldIndexes.size());
+        for (const QModelIndex &oldIndex : oldIndexes)
+            newIndexes.append(index(newRowForOldRow.at(oldIndex.row()), oldIndex.column()));
+        changePersistentIndexList(oldIndexes, newIndexes);
+
+        emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+    }
+
 private:
-    QVector<CountryData> m_data;
+    CountryColumns m_columns;
+    MappedCountries m_mappedCountries;
 };
 
+// The benchmarks include this file, with their own main()
+#ifndef DND_BENCHMARK
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("view", "list (default), table or tree", "[view]");
+    parser.addPositionalArgument("file", "A countries file with fixed-width records (see --generate-file), for testing huge models", "[file]");
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.rows, syntheticDataOptions.generateFile, syntheticDataOptions.seed});
+    parser.process(app);
+
     CountryModel model;
 
-    const QVector<CountryData> data = {
+    QVector<CountryData> data = {
         {"USA", 331}, {"China", 1439}, {"India", 1380}, {"Brazil", 213}, {"France", 67},
     };
+    if (parser.isSet(syntheticDataOptions.rows)) {
+        SyntheticData generator(SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+        const int rowCount = SyntheticDataOptions::intValue(parser, syntheticDataOptions.rows);
+        if (parser.isSet(syntheticDataOptions.generateFile)) {
+            // Stream the rows to a file instead, then pass it as [file]: that scales to more rows than fit in memory
+            const QString fileName = parser.value(syntheticDataOptions.generateFile);
+            const bool ok = MappedCountries::writeFile(fileName, rowCount, [&generator](qint64) {
+                return QPair<QString, int>{generator.name(), generator.skewed(1, 1500, 4.0)}; // same rows as without the file
+            });
+            if (!ok)
+                qWarning() << "Could not write" << fileName;
+            return ok ? 0 : 1;
+        }
+        data.clear();
+        data.reserve(rowCount);
+        for (int row = 0; row < rowCount; ++row)
+            data.append({generator.name(), generator.skewed(1, 1500, 4.0)}); // mostly small countries
+    }
     model.setCountryData(data);
 
     // Create the view
     QAbstractItemView *view = nullptr;
-    const auto args = QCoreApplication::arguments();
-    const QString viewType = args.size() > 1 ? args.at(1) : "list";
+    const QStringList args = parser.positionalArguments();
+    const QString viewType = args.value(0, "list");
+    if (args.size() > 1 && !model.setCountryFile(args.at(1))) {
+        qWarning() << "Could not open" << args.at(1);
+        return 1;
+    }
     if (viewType == "list") {
         auto listView = new QListView;
         listView->setWindowTitle("Reorderable QListView");
@@ -243,7 +438,17 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    view->setModel(&model);
+    if (auto header = viewType == "table" ? static_cast<QTableView *>(view)->horizontalHeader()
+                      : viewType == "tree" ? static_cast<QTreeView *>(view)->header()
+                                           : nullptr) {
+        // Clicking on a header section sorts once by that column.
+        // We don't use setSortingEnabled(true), a permanently sorted view would prevent reordering.
+        header->setSectionsClickable(true);
+        header->setSortIndicatorShown(true);
+        QObject::connect(header, &QHeaderView::sortIndicatorChanged, &model, &CountryModel::sort);
+    }
+
+    view->setModel(InstrumentedModel::instrument(&model, "CountryModel"));
     view->setSelectionBehavior(QAbstractItemView::SelectRows);
 
     // Note: this takes care of setDragEnabled(true) + setAcceptDrops(true)
@@ -256,5 +461,6 @@ int main(int argc, char *argv[])
 
     return app.exec();
 }
+#endif
 
 #include "reorder-with-model-view.moc"
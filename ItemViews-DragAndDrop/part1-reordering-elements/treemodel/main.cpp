@@ -1,9 +1,12 @@
 // Copyright (C) 2016 The Qt Company Ltd.
 // SPDX-License-Identifier: LicenseRef-Qt-Commercial OR BSD-3-Clause
 
+#include "model-instrumentation.h"
+#include "synthetic-data.h"
 #include "treemodel.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QFile>
 #include <QScreen>
 #include <QTreeView>
@@ -12,10 +15,23 @@ int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
-    QFile file(":/default.txt");
-    file.open(QIODevice::ReadOnly | QIODevice::Text);
-    TreeModel model(QString::fromUtf8(file.readAll()));
-    file.close();
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.depth, syntheticDataOptions.fanout, syntheticDataOptions.seed});
+    parser.process(app);
+
+    QString treeText;
+    if (parser.isSet(syntheticDataOptions.depth)) {
+        SyntheticData generator(SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+        treeText = generator.treeText(SyntheticDataOptions::intValue(parser, syntheticDataOptions.depth),
+                                      SyntheticDataOptions::intValue(parser, syntheticDataOptions.fanout));
+    } else {
+        QFile file(":/default.txt");
+        file.open(QIODevice::ReadOnly | QIODevice::Text);
+        treeText = QString::fromUtf8(file.readAll());
+    }
+    TreeModel model(treeText);
 
     QTreeView view;
 
@@ -28,7 +44,7 @@ int main(int argc, char *argv[])
     view.setSelectionMode(QAbstractItemView::ExtendedSelection);
     ////// END CHANGES FOR DND
 
-    view.setModel(&model);
+    view.setModel(InstrumentedModel::instrument(&model, "TreeModel"));
     view.setWindowTitle(TreeModel::tr("Reordering a Tree Model"));
     for (int c = 0; c < model.columnCount(); ++c)
         view.resizeColumnToContents(c);
@@ -6,6 +6,7 @@
 */
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDebug>
 #include <QDialogButtonBox>
 #include <QLabel>
@@ -15,6 +16,7 @@
 #include <QVBoxLayout>
 #include <QVector>
 #include <QWidget>
+#include "synthetic-data.h"
 
 struct CountryData
 {
@@ -83,15 +85,29 @@ int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
-    const QVector<CountryData> availableData = {
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("view", "list (default), table or tree", "[view]");
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.rows, syntheticDataOptions.seed});
+    parser.process(app);
+
+    QVector<CountryData> availableData = {
         {"USA", 331}, {"China", 1439}, {"India", 1380}, {"Brazil", 213}, {"France", 67},  {"Spain", 56},
     };
+    if (parser.isSet(syntheticDataOptions.rows)) {
+        SyntheticData generator(SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+        const int rowCount = SyntheticDataOptions::intValue(parser, syntheticDataOptions.rows);
+        availableData.clear();
+        availableData.reserve(rowCount);
+        for (int row = 0; row < rowCount; ++row)
+            availableData.append({generator.name(), generator.skewed(1, 1500, 4.0)}); // mostly small countries
+    }
     QVector<CountryData> selectedData;
     selectedData.reserve(availableData.size());
 
     auto topLevel = new TopLevelWidget(nullptr);
-    const auto args = QCoreApplication::arguments();
-    const QString viewType = args.size() > 1 ? args.at(1) : "list";
+    const QString viewType = parser.positionalArguments().value(0, "list");
     if (viewType == "list") {
         topLevel->setWindowTitle("Moving between QListWidgets");
         auto listWidget1 = new MoveOnlyListWidget;
@@ -8,6 +8,7 @@
 #include <QAbstractItemModelTester>
 #include <QAbstractTableModel>
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDebug>
 #include <QHBoxLayout>
 #include <QHeaderView>
@@ -16,10 +17,17 @@
 #include <QListView>
 #include <QMimeData>
 #include <QTableView>
+#include <QTimer>
 #include <QTreeView>
 #include <QVector>
 #include <QWidget>
 #include "check-index.h"
+#include "mapped-countries.h"
+#include "model-instrumentation.h"
+#include "synthetic-data.h"
+
+#include <algorithm>
+#include <map>
 
 struct CountryData
 {
@@ -51,16 +59,42 @@ public:
         // To catch errors during development
         new QAbstractItemModelTester(this, QAbstractItemModelTester::FailureReportingMode::Fatal, this);
 #endif
+        m_populationScanTimer.setInterval(0); // whenever the event loop is idle
+        connect(&m_populationScanTimer, &QTimer::timeout, this, &CountryModel::scanPopulationChunk);
     }
 
     enum Columns { Country, Population, COLUMNCOUNT };
 
+    struct PopulationStats
+    {
+        int count = 0;
+        qint64 sum = 0;
+        int min = 0; // min and max are only meaningful when count > 0
+        int max = 0;
+    };
+
     // Set the data for the model
     void setCountryData(const QVector<CountryData> &data)
     {
         beginResetModel();
+        m_mappedCountries.close();
         m_data = data;
+        resetPopulationStats();
+        endResetModel();
+        emit populationStatsChanged();
+    }
+
+    // Alternatively, show the records of a countries file (see MappedCountries for the format).
+    // This is O(1), whatever the size of the file: the records are only read when displayed.
+    bool setCountryFile(const QString &fileName)
+    {
+        beginResetModel();
+        m_data.clear();
+        const bool ok = m_mappedCountries.open(fileName);
+        resetPopulationStats();
         endResetModel();
+        emit populationStatsChanged();
+        return ok;
     }
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override
@@ -68,7 +102,7 @@ public:
         CHECK_rowCount(parent);
         if (parent.isValid())
             return 0; // flat model
-        return m_data.size();
+        return m_mappedCountries.isOpen() ? m_mappedCountries.size() : m_data.size();
     }
 
     int columnCount(const QModelIndex &parent = QModelIndex()) const override
@@ -84,7 +118,7 @@ public:
         if (!index.isValid() || role != Qt::DisplayRole)
             return QVariant();
 
-        const CountryData &item = m_data.at(index.row());
+        const CountryData item = countryAt(index.row());
         switch (index.column()) {
         case Columns::Country:
             return item.country;
@@ -139,7 +173,7 @@ public:
             // Note that with QTreeView, this is called for every column => deduplicate
             if (!seenRows.contains(row)) {
                 seenRows.insert(row);
-                stream << m_data.at(row);
+                stream << countryAt(row);
             }
         }
 
@@ -175,40 +209,245 @@ public:
         }
 
         // insert new countries
+        const int firstRow = row;
         beginInsertRows(parent, row, row + newCountries.count() - 1);
-        for (const CountryData &countryData : newCountries)
-            m_data.insert(row++, countryData);
+        for (const CountryData &countryData : newCountries) {
+            if (m_mappedCountries.isOpen())
+                m_mappedCountries.insertRow(row++, countryData.country, countryData.population);
+            else
+                m_data.insert(row++, countryData);
+        }
         endInsertRows();
 
+        addToPopulationStats(firstRow, newCountries.count());
+        if (m_populationStatsValid)
+            emit populationStatsChanged();
+
         return true; // let the view handle deletion on the source side by calling removeRows there
     }
 
     bool removeRows(int position, int rows, const QModelIndex &parent) override
     {
         CHECK_removeRows(position, rows, parent);
+        removeFromPopulationStats(position, rows);
+
         beginRemoveRows(parent, position, position + rows - 1);
-        for (int row = 0; row < rows; ++row) {
-            m_data.removeAt(position);
+        if (m_mappedCountries.isOpen()) {
+            m_mappedCountries.removeRows(position, rows);
+        } else {
+            for (int row = 0; row < rows; ++row) {
+                m_data.removeAt(position);
+            }
         }
         endRemoveRows();
+
+        if (m_populationStatsValid)
+            emit populationStatsChanged();
         return true;
     }
 
+    // Reordering within the same view (called by QListView when dropping onto itself)
+    bool moveRows(const QModelIndex &sourceParent, int sourceRow, int count, const QModelIndex &destinationParent, int destinationChild) override
+    {
+        CHECK_moveRows(sourceParent, sourceRow, count, destinationParent, destinationChild);
+        if (!beginMoveRows(sourceParent, sourceRow, sourceRow + count - 1, destinationParent, destinationChild))
+            return false; // invalid move, e.g. no-op (move row 2 to row 2, or move row 2 to row 3)
+
+        // Nothing to do for the population stats, the set of countries didn't change.
+        // Unless they're still being computed: rows may move into or out of the part which was scanned already.
+        // That's a removal followed by an insertion, as far as the scan is concerned.
+        const bool scanning = !m_populationStatsValid;
+        if (scanning)
+            removeFromPopulationStats(sourceRow, count);
+        if (m_mappedCountries.isOpen()) {
+            m_mappedCountries.moveRows(sourceRow, count, destinationChild);
+        } else {
+            const auto begin = m_data.begin();
+            if (destinationChild > sourceRow)
+                std::rotate(begin + sourceRow, begin + sourceRow + count, begin + destinationChild);
+            else
+                std::rotate(begin + destinationChild, begin + sourceRow, begin + sourceRow + count);
+        }
+
+        if (scanning)
+            addToPopulationStats(destinationChild > sourceRow ? destinationChild - count : destinationChild, count);
+
+        endMoveRows();
+        return true;
+    }
+
+    // After setCountryFile(), the stats are computed in the background, a chunk of records whenever
+    // the event loop is idle, and populationStatsChanged() is emitted when they're ready.
+    bool hasPopulationStats() const { return m_populationStatsValid; }
+
+    // O(1), except when called before hasPopulationStats() is true: then the rest of the records are read now.
+    // Not const for that reason, it finishes the scan.
+    PopulationStats populationStats()
+    {
+        if (!m_populationStatsValid) {
+            const int rows = rowCount();
+            for (int row = m_scannedRows; row < rows; ++row)
+                addPopulation(populationAt(row));
+            m_scannedRows = rows;
+            m_populationStatsValid = true;
+            m_populationScanTimer.stop();
+        }
+        PopulationStats stats;
+        stats.count = m_populationCount;
+        stats.sum = m_populationSum;
+        if (!m_populationHistogram.empty()) {
+            stats.min = m_populationHistogram.begin()->first;
+            stats.max = m_populationHistogram.rbegin()->first;
+        }
+        return stats;
+    }
+
+signals:
+    void populationStatsChanged();
+
 private:
+    CountryData countryAt(int row) const
+    {
+        if (m_mappedCountries.isOpen())
+            return {m_mappedCountries.country(row), m_mappedCountries.population(row)};
+        return m_data.at(row);
+    }
+
+    int populationAt(int row) const
+    {
+        return m_mappedCountries.isOpen() ? m_mappedCountries.population(row) : m_data.at(row).population;
+    }
+
+    // The stats are updated incrementally on every insertion and removal: sum and count are
+    // trivial, min and max come from a histogram (population -> number of countries with that
+    // population), so that removing the current minimum doesn't require a full rescan.
+    void resetPopulationStats()
+    {
+        m_populationHistogram.clear();
+        m_populationSum = 0;
+        m_populationCount = 0;
+        m_scannedRows = 0;
+        // For files, scan the records in the background, to keep setCountryFile() O(1)
+        m_populationStatsValid = !m_mappedCountries.isOpen();
+        if (m_populationStatsValid) {
+            m_populationScanTimer.stop();
+            for (const CountryData &countryData : std::as_const(m_data))
+                addPopulation(countryData.population);
+            m_scannedRows = int(m_data.size());
+        } else {
+            m_populationScanTimer.start();
+        }
+    }
+
+    // The stats cover the rows before m_scannedRows (all of them, once the scan is over). Rows inserted
+    // or removed there are added to the stats, or removed from them, right away; the rows after it are
+    // left to the scan. So editing doesn't restart the scan, which would never finish with frequent edits.
+    // To be called after inserting the rows.
+    void addToPopulationStats(int firstRow, int count)
+    {
+        if (firstRow > m_scannedRows)
+            return;
+        for (int row = firstRow; row < firstRow + count; ++row)
+            addPopulation(populationAt(row));
+        m_scannedRows += count;
+    }
+
+    // To be called before removing the rows
+    void removeFromPopulationStats(int firstRow, int count)
+    {
+        const int end = std::min(firstRow + count, m_scannedRows);
+        for (int row = firstRow; row < end; ++row)
+            removePopulation(populationAt(row));
+        m_scannedRows -= std::max(0, end - firstRow);
+    }
+
+    // Small enough chunks to keep the UI responsive, even with the file's pages not in memory yet
+    void scanPopulationChunk()
+    {
+        const int rows = rowCount();
+        const int end = std::min(rows, m_scannedRows + 64 * 1024);
+        for (int row = m_scannedRows; row < end; ++row)
+            addPopulation(populationAt(row));
+        m_scannedRows = end;
+        if (end == rows) {
+            m_populationStatsValid = true;
+            m_populationScanTimer.stop();
+            emit populationStatsChanged();
+        }
+    }
+
+    void addPopulation(int population)
+    {
+        ++m_populationHistogram[population];
+        m_populationSum += population;
+        ++m_populationCount;
+    }
+
+    void removePopulation(int population)
+    {
+        const auto it = m_populationHistogram.find(population);
+        Q_ASSERT(it != m_populationHistogram.end());
+        if (--it->second == 0)
+            m_populationHistogram.erase(it);
+        m_populationSum -= population;
+        --m_populationCount;
+    }
+
     QVector<CountryData> m_data;
+    MappedCountries m_mappedCountries;
+
+    std::map<int, int> m_populationHistogram;
+    qint64 m_populationSum = 0;
+    int m_populationCount = 0;
+    bool m_populationStatsValid = true;
+    int m_scannedRows = 0; // the stats cover the rows before this one, see addToPopulationStats()
+    QTimer m_populationScanTimer;
 };
 
+// The benchmarks include this file, with their own main()
+#ifndef DND_BENCHMARK
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("view", "list (default), table or tree", "[view]");
+    parser.addPositionalArgument("file", "A countries file with fixed-width records (see --generate-file), for testing huge models", "[file]");
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.rows, syntheticDataOptions.generateFile, syntheticDataOptions.seed});
+    parser.process(app);
+
     CountryModel model1;
     CountryModel model2;
 
-    const QVector<CountryData> data1 = {
+    QVector<CountryData> data1 = {
         {"USA", 331}, {"China", 1439}, {"India", 1380}, {"Brazil", 213}, {"France", 67},
     };
+    if (parser.isSet(syntheticDataOptions.rows)) {
+        SyntheticData generator(SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+        const int rowCount = SyntheticDataOptions::intValue(parser, syntheticDataOptions.rows);
+        if (parser.isSet(syntheticDataOptions.generateFile)) {
+            // Stream the rows to a file instead, then pass it as [file]: that scales to more rows than fit in memory
+            const QString fileName = parser.value(syntheticDataOptions.generateFile);
+            const bool ok = MappedCountries::writeFile(fileName, rowCount, [&generator](qint64) {
+                return QPair<QString, int>{generator.name(), generator.skewed(1, 1500, 4.0)}; // same rows as without the file
+            });
+            if (!ok)
+                qWarning() << "Could not write" << fileName;
+            return ok ? 0 : 1;
+        }
+        data1.clear();
+        data1.reserve(rowCount);
+        for (int row = 0; row < rowCount; ++row)
+            data1.append({generator.name(), generator.skewed(1, 1500, 4.0)}); // mostly small countries
+    }
     model1.setCountryData(data1);
+    const QStringList args = parser.positionalArguments();
+    if (args.size() > 1 && !model1.setCountryFile(args.at(1))) {
+        qWarning() << "Could not open" << args.at(1);
+        return 1;
+    }
     const QVector<CountryData> data2 = {
         {"Spain", 56},
     };
@@ -216,11 +455,32 @@ int main(int argc, char *argv[])
     auto topLevel = new QWidget(nullptr);
     auto layout = new QHBoxLayout(topLevel);
 
-    const auto setupView = [&](QAbstractItemView *view, const QString &title) {
+    const auto setupView = [&](QAbstractItemView *view, const QString &title, CountryModel *model) {
         auto vLayout = new QVBoxLayout;
         layout->addLayout(vLayout);
         vLayout->addWidget(new QLabel(title, topLevel));
         vLayout->addWidget(view);
+        view->setModel(InstrumentedModel::instrument(model, "CountryModel-" + title));
+
+        auto totalsLabel = new QLabel(topLevel);
+        vLayout->addWidget(totalsLabel);
+        const auto updateTotals = [totalsLabel, model]() {
+            if (!model->hasPopulationStats()) { // don't block the startup with reading a huge file
+                totalsLabel->setText(QStringLiteral("%1 countries, computing the totals...").arg(model->rowCount()));
+                return;
+            }
+            const CountryModel::PopulationStats stats = model->populationStats();
+            if (stats.count == 0)
+                totalsLabel->setText(QStringLiteral("No countries"));
+            else
+                totalsLabel->setText(QStringLiteral("%1 countries, %2 million people (min %3, max %4)")
+                                         .arg(stats.count)
+                                         .arg(stats.sum)
+                                         .arg(stats.min)
+                                         .arg(stats.max));
+        };
+        QObject::connect(model, &CountryModel::populationStatsChanged, totalsLabel, updateTotals);
+        updateTotals();
         view->setSelectionMode(QAbstractItemView::ExtendedSelection);
         view->setSelectionBehavior(QAbstractItemView::SelectRows);
 
@@ -231,24 +491,19 @@ int main(int argc, char *argv[])
 
     // Create the views
     QAbstractItemView *view = nullptr;
-    const auto args = QCoreApplication::arguments();
-    const QString viewType = args.size() > 1 ? args.at(1) : "list";
+    const QString viewType = args.value(0, "list");
     if (viewType == "list") {
         topLevel->setWindowTitle("Moving between QListViews");
         auto listView1 = new QListView(topLevel);
-        setupView(listView1, "Available");
-        listView1->setModel(&model1);
+        setupView(listView1, "Available", &model1);
         auto listView2 = new QListView(topLevel);
-        setupView(listView2, "Selected");
-        listView2->setModel(&model2);
+        setupView(listView2, "Selected", &model2);
     } else if (viewType == "table") {
         topLevel->setWindowTitle("Moving between QTableViews");
         auto tableView1 = new QTableView;
-        setupView(tableView1, "Available");
-        tableView1->setModel(&model1);
+        setupView(tableView1, "Available", &model1);
         auto tableView2 = new QTableView;
-        setupView(tableView2, "Selected");
-        tableView2->setModel(&model2);
+        setupView(tableView2, "Selected", &model2);
 
         tableView1->horizontalHeader()->resizeSections(QHeaderView::ResizeToContents);
         tableView2->horizontalHeader()->resizeSections(QHeaderView::ResizeToContents);
@@ -260,11 +515,9 @@ int main(int argc, char *argv[])
     } else if (viewType == "tree") {
         topLevel->setWindowTitle("Moving between QTreeViews");
         auto treeView1 = new QTreeView;
-        setupView(treeView1, "Available");
-        treeView1->setModel(&model1);
+        setupView(treeView1, "Available", &model1);
         auto treeView2 = new QTreeView;
-        setupView(treeView2, "Selected");
-        treeView2->setModel(&model2);
+        setupView(treeView2, "Selected", &model2);
 
         treeView1->header()->resizeSections(QHeaderView::ResizeToContents);
         treeView2->header()->resizeSections(QHeaderView::ResizeToContents);
@@ -278,5 +531,6 @@ int main(int argc, char *argv[])
 
     return app.exec();
 }
+#endif
 
 #include "move-between-views-with-model-view.moc"
@@ -1,9 +1,12 @@
 // Copyright (C) 2016 The Qt Company Ltd.
 // SPDX-License-Identifier: LicenseRef-Qt-Commercial OR BSD-3-Clause
 
+#include "model-instrumentation.h"
+#include "synthetic-data.h"
 #include "treemodel.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QFile>
 #include <QHeaderView>
 #include <QLabel>
@@ -16,7 +19,8 @@ class MainWindow : public QWidget
     Q_OBJECT
 
 public:
-    explicit MainWindow(QWidget *parent = nullptr)
+    // Shows `treeText` (in the format of default.txt) in the first view
+    explicit MainWindow(const QString &treeText, QWidget *parent = nullptr)
         : QWidget(parent)
     {
         auto topLayout = new QVBoxLayout(this);
@@ -25,11 +29,8 @@ public:
         topLayout->addWidget(label);
 
         auto view1 = new QTreeView(this);
-        QFile file(":/default.txt");
-        file.open(QIODevice::ReadOnly | QIODevice::Text);
-        auto model1 = new TreeModel(QString::fromUtf8(file.readAll()), this);
-        file.close();
-        view1->setModel(model1);
+        auto model1 = new TreeModel(treeText, this);
+        view1->setModel(InstrumentedModel::instrument(model1, "TreeModel1"));
         setupViewForDnD(view1);
         for (int c = 0; c < model1->columnCount(); ++c)
             view1->resizeColumnToContents(c);
@@ -41,7 +42,7 @@ public:
 
         auto view2 = new QTreeView(this);
         auto model2 = new TreeModel(QString{}, this); // initially empty
-        view2->setModel(model2);
+        view2->setModel(InstrumentedModel::instrument(model2, "TreeModel2"));
         setupViewForDnD(view2);
         view2->header()->resizeSection(0, view1->header()->sectionSize(0));
         topLayout->addWidget(view2);
@@ -63,7 +64,24 @@ int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
-    MainWindow mw;
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.depth, syntheticDataOptions.fanout, syntheticDataOptions.seed});
+    parser.process(app);
+
+    QString treeText;
+    if (parser.isSet(syntheticDataOptions.depth)) {
+        SyntheticData generator(SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+        treeText = generator.treeText(SyntheticDataOptions::intValue(parser, syntheticDataOptions.depth),
+                                      SyntheticDataOptions::intValue(parser, syntheticDataOptions.fanout));
+    } else {
+        QFile file(":/default.txt");
+        file.open(QIODevice::ReadOnly | QIODevice::Text);
+        treeText = QString::fromUtf8(file.readAll());
+    }
+
+    MainWindow mw(treeText);
     mw.setWindowTitle(TreeModel::tr("Move Between Tree Views"));
     mw.showMaximized();
 
@@ -8,7 +8,9 @@
 #include <QAbstractItemModelTester>
 #include <QAbstractTableModel>
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDebug>
+#include <QHash>
 #include <QHBoxLayout>
 #include <QHeaderView>
 #include <QIODevice>
@@ -20,11 +22,14 @@
 #include <QVector>
 #include <QWidget>
 #include "check-index.h"
+#include "model-instrumentation.h"
+#include "synthetic-data.h"
 
 struct EmailFolder
 {
     QString folderName;
     QStringList emails;
+    int id = -1; // unique, assigned by FoldersModel
 };
 
 using EmailFolders = QVector<EmailFolder>;
@@ -100,8 +105,8 @@ public:
         QByteArray encodedData;
         QDataStream stream(&encodedData, QIODevice::WriteOnly);
 
-        // Serialize source folder name (to detect dropping onto the same folder)
-        stream << m_emailFolder->folderName;
+        // Serialize source folder ID (to detect dropping onto the same folder)
+        stream << m_emailFolder->id;
 
         // Serialize email contents
         for (const QModelIndex &index : indexes) {
@@ -133,6 +138,11 @@ public:
     void setEmailFolders(EmailFolders *emailFolders)
     {
         m_emailFolders = emailFolders;
+        m_foldersById.clear();
+        for (EmailFolder &folder : *m_emailFolders) {
+            folder.id = m_nextFolderId++;
+            m_foldersById.insert(folder.id, &folder);
+        }
 #ifndef QT_NO_DEBUG
         // To catch errors during development
         new QAbstractItemModelTester(this, QAbstractItemModelTester::FailureReportingMode::Fatal, this);
@@ -160,6 +170,8 @@ public:
 
     EmailFolder *folderForIndex(const QModelIndex &index) { return &(*m_emailFolders)[index.row()]; }
 
+    EmailFolder *folderForId(int id) const { return m_foldersById.value(id); }
+
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
     {
         CHECK_data(index);
@@ -222,10 +234,12 @@ public:
         QDataStream stream(encodedData);
         if (stream.atEnd())
             return false;
-        QString sourceFolder;
-        stream >> sourceFolder;
+        int sourceFolderId;
+        stream >> sourceFolderId;
         // Dropping onto the same folder?
-        if (sourceFolder == destFolder->folderName)
+        // (comparing IDs rather than names: different folders can have the same name)
+        EmailFolder *sourceFolder = folderForId(sourceFolderId);
+        if (sourceFolder == destFolder)
             return false;
 
         while (!stream.atEnd()) {
@@ -240,13 +254,16 @@ public:
 
 private:
     EmailFolders *m_emailFolders = nullptr;
+    QHash<int, EmailFolder *> m_foldersById;
+    int m_nextFolderId = 0;
 };
 
 enum class ViewType { List, Table, Tree };
 class TopLevel : public QWidget
 {
 public:
-    explicit TopLevel(ViewType viewType);
+    // Shows `emails`, or the built-in data if empty
+    explicit TopLevel(ViewType viewType, const EmailFolders &emails = EmailFolders());
 
 private:
     // Application data
@@ -263,8 +280,11 @@ private:
     EmailsModel m_emailsModel;
 };
 
-TopLevel::TopLevel(ViewType viewType) : QWidget(nullptr)
+TopLevel::TopLevel(ViewType viewType, const EmailFolders &emails) : QWidget(nullptr)
 {
+    if (!emails.isEmpty())
+        m_emails = emails;
+
     m_foldersModel.setEmailFolders(&m_emails);
 
     auto layout = new QHBoxLayout(this);
@@ -273,7 +293,7 @@ TopLevel::TopLevel(ViewType viewType) : QWidget(nullptr)
     const auto setupFoldersView = [&](QAbstractItemView *view) {
         layout->addWidget(view);
         view->setSelectionMode(QAbstractItemView::ExtendedSelection);
-        view->setModel(&m_foldersModel);
+        view->setModel(InstrumentedModel::instrument(&m_foldersModel, "FoldersModel"));
 
         // Note: this takes care of setAcceptDrops(true)
         view->setDragDropMode(QAbstractItemView::DropOnly);
@@ -281,7 +301,7 @@ TopLevel::TopLevel(ViewType viewType) : QWidget(nullptr)
         view->setDragDropOverwriteMode(true);
 
         connect(view, &QAbstractItemView::clicked, view, [&](const QModelIndex &index) {
-            m_emailsModel.setEmails(m_foldersModel.folderForIndex(index));
+            m_emailsModel.setEmails(m_foldersModel.folderForIndex(InstrumentedModel::sourceIndex(index)));
         });
         m_emailsModel.setEmails(&m_emails[0]);
     };
@@ -290,7 +310,7 @@ TopLevel::TopLevel(ViewType viewType) : QWidget(nullptr)
     const auto setupEmailsView = [&](QAbstractItemView *view) {
         layout->addWidget(view);
         view->setMaximumWidth(400);
-        view->setModel(&m_emailsModel);
+        view->setModel(InstrumentedModel::instrument(&m_emailsModel, "EmailsModel"));
         view->setSelectionMode(QAbstractItemView::ExtendedSelection);
 
         view->setDragDropMode(QAbstractItemView::DragOnly);
@@ -346,8 +366,22 @@ int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
-    const auto args = QCoreApplication::arguments();
-    const QString arg = args.size() > 1 ? args.at(1) : "list";
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("view", "list (default), table or tree", "[view]");
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.folders, syntheticDataOptions.emailsPerFolder, syntheticDataOptions.seed});
+    parser.process(app);
+
+    EmailFolders emails;
+    if (parser.isSet(syntheticDataOptions.folders)) {
+        // Folder sizes follow Zipf's law: a few huge folders, and many small ones
+        SyntheticData generator(SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+        emails = generator.emailFolders<EmailFolders>(SyntheticDataOptions::intValue(parser, syntheticDataOptions.folders),
+                                                      SyntheticDataOptions::intValue(parser, syntheticDataOptions.emailsPerFolder));
+    }
+
+    const QString arg = parser.positionalArguments().value(0, "list");
     ViewType viewType;
     if (arg == "list")
         viewType = ViewType::List;
@@ -358,7 +392,7 @@ int main(int argc, char *argv[])
     else
         return 1;
 
-    auto topLevel = new TopLevel(viewType);
+    auto topLevel = new TopLevel(viewType, emails);
     topLevel->resize(700, 400);
     topLevel->show();
     topLevel->setAttribute(Qt::WA_DeleteOnClose);
@@ -6,13 +6,17 @@
 */
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDebug>
 #include <QIODevice>
 #include <QMimeData>
+#include <QSet>
 #include <QListWidget>
 #include <QVBoxLayout>
 #include <QVector>
 #include <QWidget>
+#include "remove-sorted-rows.h"
+#include "synthetic-data.h"
 
 struct EmailFolder
 {
@@ -62,23 +66,33 @@ bool FoldersListWidget::dropMimeData(int index, const QMimeData *mimeData, Qt::D
 
     QList<qintptr> emailItemPointers;
     stream >> emailItemPointers;
+    if (emailItemPointers.isEmpty())
+        return false;
+    QSet<QListWidgetItem *> emailItems;
+    emailItems.reserve(emailItemPointers.size());
     for (qintptr emailItemPointer : std::as_const(emailItemPointers))
     {
         const auto emailItem = reinterpret_cast<QListWidgetItem *>(emailItemPointer);
         // Add to data structure
         destFolder->emails.append(emailItem->text());
         // (no need to add to UI, that folder is never visible)
+        emailItems.insert(emailItem);
+    }
 
-        // We have to handle deletion of the source, in case of a move, instead of just
-        // letting QListWidget do it by returning true.
-        // This is because if we let QListWidget delete the source item, it won't notify us and we won't
-        // be able to update EmailFolder::emails. So it's all done here and we return false at the end.
-        if (action == Qt::MoveAction) {
-            // Remove from data structure
-            sourceFolder->emails.removeAt(emailItem->listWidget()->row(emailItem));
-            // Remove from UI
-            delete emailItem;
+    // We have to handle deletion of the source, in case of a move, instead of just
+    // letting QListWidget do it by returning true.
+    // This is because if we let QListWidget delete the source items, it won't notify us and we won't
+    // be able to update EmailFolder::emails. So it's all done here and we return false at the end.
+    if (action == Qt::MoveAction) {
+        QListWidget *emailsWidget = reinterpret_cast<QListWidgetItem *>(emailItemPointers.first())->listWidget();
+        // Find the rows of all the dropped items in a single pass
+        QVector<int> rows;
+        rows.reserve(emailItems.size());
+        for (int row = 0; row < emailsWidget->count(); ++row) {
+            if (emailItems.contains(emailsWidget->item(row)))
+                rows.append(row);
         }
+        removeSortedRows(sourceFolder->emails, emailsWidget->model(), rows);
     }
 
     return false;
@@ -105,11 +119,17 @@ private:
 void EmailsListWidget::fillEmailsList(EmailFolder &folder)
 {
     m_folder = &folder;
-    clear();
-    for (const QString &email : folder.emails) {
-        // QListWidgetItem has ItemIsDragEnabled set by default
-        addItem(new QListWidgetItem(email));
-    }
+    clearSelection();
+    // Rather than clear() and creating new items, reuse the items of the previous folder
+    const int emailCount = folder.emails.size();
+    if (count() > emailCount)
+        model()->removeRows(emailCount, count() - emailCount); // in one go
+    const int reusedCount = count();
+    for (int row = 0; row < reusedCount; ++row)
+        item(row)->setText(folder.emails.at(row));
+    // QListWidgetItem has ItemIsDragEnabled set by default
+    addItems(folder.emails.mid(reusedCount)); // a single row insertion
+    scrollToTop();
 }
 
 #if QT_VERSION >= QT_VERSION_CHECK(6,0,0)
@@ -143,7 +163,8 @@ QMimeData *EmailsListWidget::mimeData(const QList<QListWidgetItem *> items) cons
 class TopLevel : public QWidget
 {
 public:
-    TopLevel();
+    // Shows `emails`, or the built-in data if empty
+    explicit TopLevel(const EmailFolders &emails = EmailFolders());
 
 private:
     void fillFoldersListWidget(QListWidget *foldersListWidget);
@@ -169,9 +190,12 @@ void TopLevel::fillFoldersListWidget(QListWidget *foldersListWidget)
     }
 }
 
-TopLevel::TopLevel()
+TopLevel::TopLevel(const EmailFolders &emails)
     : QWidget(nullptr)
 {
+    if (!emails.isEmpty())
+        m_emails = emails;
+
     auto layout = new QHBoxLayout(this);
 
     // Drop side (left)
@@ -215,15 +239,31 @@ TopLevel::TopLevel()
     });
 }
 
+// The benchmarks include this file, with their own main()
+#ifndef DND_BENCHMARK
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
-    auto topLevel = new TopLevel();
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.folders, syntheticDataOptions.emailsPerFolder, syntheticDataOptions.seed});
+    parser.process(app);
+
+    EmailFolders emails;
+    if (parser.isSet(syntheticDataOptions.folders)) {
+        // Folder sizes follow Zipf's law: a few huge folders, and many small ones
+        SyntheticData generator(SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+        emails = generator.emailFolders<EmailFolders>(SyntheticDataOptions::intValue(parser, syntheticDataOptions.folders),
+                                                      SyntheticDataOptions::intValue(parser, syntheticDataOptions.emailsPerFolder));
+    }
+
+    auto topLevel = new TopLevel(emails);
     topLevel->resize(700, 400);
     topLevel->show();
     topLevel->setAttribute(Qt::WA_DeleteOnClose);
 
     return app.exec();
 }
-
+#endif
@@ -6,14 +6,19 @@
 */
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDebug>
+#include <QHash>
 #include <QIODevice>
 #include <QHeaderView>
 #include <QMimeData>
+#include <QSet>
 #include <QTableWidget>
 #include <QVBoxLayout>
 #include <QVector>
 #include <QWidget>
+#include "remove-sorted-rows.h"
+#include "synthetic-data.h"
 
 struct EmailFolder
 {
@@ -35,11 +40,13 @@ public:
 
 protected:
     void updateCounts();
+    void updateCount(EmailFolder *folder);
     QStringList mimeTypes() const override { return {QString::fromLatin1(s_emailsMimeType)}; }
     bool dropMimeData(int row, int column, const QMimeData *mimeData, Qt::DropAction action) override;
 
 private:
     EmailFolders *m_folders = nullptr;
+    QHash<EmailFolder *, QTableWidgetItem *> m_countItems; // so that a drop only updates the two folders involved
 };
 
 void FoldersTableWidget::setEmailFolders(EmailFolders *folders)
@@ -49,6 +56,7 @@ void FoldersTableWidget::setEmailFolders(EmailFolders *folders)
     setColumnCount(2);
     setHorizontalHeaderLabels({"Folder", "Count"});
     verticalHeader()->hide();
+    m_countItems.clear();
     for (int row = 0; row < m_folders->size(); ++row) {
         EmailFolder &folder = (*m_folders)[row];
         auto item = new QTableWidgetItem(folder.folderName);
@@ -61,6 +69,7 @@ void FoldersTableWidget::setEmailFolders(EmailFolders *folders)
         countItem->setFlags(countItem->flags() & ~Qt::ItemIsDragEnabled);
         countItem->setData(Qt::UserRole, QVariant::fromValue(&folder));
         setItem(row, 1, countItem);
+        m_countItems.insert(&folder, countItem);
     }
     updateCounts();
 }
@@ -72,6 +81,12 @@ void FoldersTableWidget::updateCounts()
     }
 }
 
+void FoldersTableWidget::updateCount(EmailFolder *folder)
+{
+    if (QTableWidgetItem *countItem = m_countItems.value(folder))
+        countItem->setData(Qt::DisplayRole, folder->emails.size());
+}
+
 bool FoldersTableWidget::dropMimeData(int row, int column, const QMimeData *mimeData, Qt::DropAction action)
 {
     auto destFolder = item(row, column)->data(Qt::UserRole).value<EmailFolder *>();
@@ -99,27 +114,38 @@ bool FoldersTableWidget::dropMimeData(int row, int column, const QMimeData *mime
 
     QList<qintptr> emailItemPointers;
     stream >> emailItemPointers;
+    if (emailItemPointers.isEmpty())
+        return false;
+    QSet<QTableWidgetItem *> emailItems;
+    emailItems.reserve(emailItemPointers.size());
     for (qintptr emailItemPointer : std::as_const(emailItemPointers))
     {
         const auto emailItem = reinterpret_cast<QTableWidgetItem *>(emailItemPointer);
         // Add to data structure
         destFolder->emails.append(emailItem->text());
         // (no need to add to UI, that folder is never visible)
+        emailItems.insert(emailItem);
+    }
 
-        // We have to handle deletion of the source, in case of a move, instead of just
-        // letting QTableWidget do it by returning true.
-        // This is because if we let QTableWidget delete the source item, it won't notify us and we won't
-        // be able to update EmailFolder::emails. So it's all done here and we return false at the end.
-        if (action == Qt::MoveAction) {
-            const int sourceRow = emailItem->tableWidget()->row(emailItem);
-            // Remove from data structure
-            sourceFolder->emails.removeAt(sourceRow);
-            // Remove from UI
-            emailItem->tableWidget()->removeRow(sourceRow);
+    // We have to handle deletion of the source, in case of a move, instead of just
+    // letting QTableWidget do it by returning true.
+    // This is because if we let QTableWidget delete the source items, it won't notify us and we won't
+    // be able to update EmailFolder::emails. So it's all done here and we return false at the end.
+    if (action == Qt::MoveAction) {
+        QTableWidget *emailsWidget = reinterpret_cast<QTableWidgetItem *>(emailItemPointers.first())->tableWidget();
+        // Find the rows of all the dropped items in a single pass (the emails are in column 0)
+        QVector<int> rows;
+        rows.reserve(emailItems.size());
+        for (int row = 0; row < emailsWidget->rowCount(); ++row) {
+            if (emailItems.contains(emailsWidget->item(row, 0)))
+                rows.append(row);
         }
+        removeSortedRows(sourceFolder->emails, emailsWidget->model(), rows);
     }
 
-    updateCounts();
+    // Only these two changed, no need to go through all the folders
+    updateCount(sourceFolder);
+    updateCount(destFolder);
 
     return false;
 }
@@ -145,14 +171,21 @@ private:
 void EmailsTableWidget::fillEmailsList(EmailFolder &folder)
 {
     m_folder = &folder;
-    clear();
+    clearSelection();
+    // Rather than clear() and creating new items, reuse the items of the previous folder.
+    // setRowCount() adds or removes the difference, in one go
     setRowCount(folder.emails.size());
     setColumnCount(1);
     setHorizontalHeaderLabels({"Emails"});
     for (int row = 0; row < folder.emails.size(); ++row) {
-        // QTableWidgetItem has ItemIsDragEnabled and Qt::ItemIsDropEnabled set by default!
-        setItem(row, 0, new QTableWidgetItem(folder.emails.at(row)));
+        if (QTableWidgetItem *emailItem = item(row, 0)) {
+            emailItem->setText(folder.emails.at(row));
+        } else {
+            // QTableWidgetItem has ItemIsDragEnabled and Qt::ItemIsDropEnabled set by default!
+            setItem(row, 0, new QTableWidgetItem(folder.emails.at(row)));
+        }
     }
+    scrollToTop();
     horizontalHeader()->resizeSections(QHeaderView::ResizeToContents);
 }
 
@@ -187,7 +220,8 @@ QMimeData *EmailsTableWidget::mimeData(const QList<QTableWidgetItem *> items) co
 class TopLevel : public QWidget
 {
 public:
-    TopLevel();
+    // Shows `emails`, or the built-in data if empty
+    explicit TopLevel(const EmailFolders &emails = EmailFolders());
 
 private:
     // Application data
@@ -201,9 +235,12 @@ private:
     };
 };
 
-TopLevel::TopLevel()
+TopLevel::TopLevel(const EmailFolders &emails)
     : QWidget(nullptr)
 {
+    if (!emails.isEmpty())
+        m_emails = emails;
+
     auto layout = new QHBoxLayout(this);
 
     // Drop side (left)
@@ -251,15 +288,31 @@ TopLevel::TopLevel()
     });
 }
 
+// The benchmarks include this file, with their own main()
+#ifndef DND_BENCHMARK
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
-    auto topLevel = new TopLevel();
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.folders, syntheticDataOptions.emailsPerFolder, syntheticDataOptions.seed});
+    parser.process(app);
+
+    EmailFolders emails;
+    if (parser.isSet(syntheticDataOptions.folders)) {
+        // Folder sizes follow Zipf's law: a few huge folders, and many small ones
+        SyntheticData generator(SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+        emails = generator.emailFolders<EmailFolders>(SyntheticDataOptions::intValue(parser, syntheticDataOptions.folders),
+                                                      SyntheticDataOptions::intValue(parser, syntheticDataOptions.emailsPerFolder));
+    }
+
+    auto topLevel = new TopLevel(emails);
     topLevel->resize(700, 400);
     topLevel->show();
     topLevel->setAttribute(Qt::WA_DeleteOnClose);
 
     return app.exec();
 }
-
+#endif
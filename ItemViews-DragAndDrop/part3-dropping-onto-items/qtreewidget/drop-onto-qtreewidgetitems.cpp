@@ -6,14 +6,19 @@
 */
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDebug>
+#include <QHash>
 #include <QIODevice>
 #include <QHeaderView>
 #include <QMimeData>
+#include <QSet>
 #include <QTreeWidget>
 #include <QVBoxLayout>
 #include <QVector>
 #include <QWidget>
+#include "remove-sorted-rows.h"
+#include "synthetic-data.h"
 
 struct EmailFolder
 {
@@ -30,25 +35,42 @@ class FoldersTreeWidget : public QTreeWidget
 {
 public:
     using QTreeWidget::QTreeWidget;
-    void setEmailFolders(EmailFolders *folders) { m_folders = folders; updateCounts(); }
+    void setEmailFolders(EmailFolders *folders);
 
 protected:
     void updateCounts();
+    void updateCount(EmailFolder *folder);
     QStringList mimeTypes() const override { return {QString::fromLatin1(s_emailsMimeType)}; }
     bool dropMimeData(QTreeWidgetItem *destItem, int index, const QMimeData *mimeData, Qt::DropAction action) override;
 
 private:
     EmailFolders *m_folders = nullptr;
+    QHash<EmailFolder *, QTreeWidgetItem *> m_folderItems; // so that a drop only updates the two folders involved
 };
 
-void FoldersTreeWidget::updateCounts()
+// Call this once the folder items are created
+void FoldersTreeWidget::setEmailFolders(EmailFolders *folders)
 {
+    m_folders = folders;
+    m_folderItems.clear();
     QTreeWidgetItemIterator it(this);
-     while (*it) {
-         auto folder = (*it)->data(0, Qt::UserRole).value<EmailFolder *>();
-         (*it)->setData(1, Qt::DisplayRole, folder->emails.size());
-         ++it;
-     }
+    while (*it) {
+        m_folderItems.insert((*it)->data(0, Qt::UserRole).value<EmailFolder *>(), *it);
+        ++it;
+    }
+    updateCounts();
+}
+
+void FoldersTreeWidget::updateCounts()
+{
+    for (auto it = m_folderItems.cbegin(); it != m_folderItems.cend(); ++it)
+        it.value()->setData(1, Qt::DisplayRole, it.key()->emails.size());
+}
+
+void FoldersTreeWidget::updateCount(EmailFolder *folder)
+{
+    if (QTreeWidgetItem *item = m_folderItems.value(folder))
+        item->setData(1, Qt::DisplayRole, folder->emails.size());
 }
 
 bool FoldersTreeWidget::dropMimeData(QTreeWidgetItem *destItem, int index, const QMimeData *mimeData, Qt::DropAction action)
@@ -77,28 +99,39 @@ bool FoldersTreeWidget::dropMimeData(QTreeWidgetItem *destItem, int index, const
 
     QList<qintptr> emailItemPointers;
     stream >> emailItemPointers;
+    if (emailItemPointers.isEmpty())
+        return false;
+    QSet<QTreeWidgetItem *> emailItems;
+    emailItems.reserve(emailItemPointers.size());
     for (qintptr emailItemPointer : std::as_const(emailItemPointers))
     {
         const auto emailItem = reinterpret_cast<QTreeWidgetItem *>(emailItemPointer);
         // Add to data structure
         destFolder->emails.append(emailItem->text(0));
         // (no need to add to UI, that folder is never visible)
+        emailItems.insert(emailItem);
+    }
 
-        // We have to handle deletion of the source, in case of a move, instead of just
-        // letting QTreeWidget do it by returning true.
-        // This is because if we let QTreeWidget delete the source item, it won't notify us and we won't
-        // be able to update EmailFolder::emails. So it's all done here and we return false at the end.
-        if (action == Qt::MoveAction) {
-            auto parent = emailItem->parent() ? emailItem->parent() : emailItem->treeWidget()->invisibleRootItem();
-            const int index = parent->indexOfChild(emailItem);
-            // Remove from data structure
-            sourceFolder->emails.removeAt(index);
-            // Remove from UI
-            delete emailItem;
+    // We have to handle deletion of the source, in case of a move, instead of just
+    // letting QTreeWidget do it by returning true.
+    // This is because if we let QTreeWidget delete the source items, it won't notify us and we won't
+    // be able to update EmailFolder::emails. So it's all done here and we return false at the end.
+    if (action == Qt::MoveAction) {
+        // The emails are toplevel items
+        QTreeWidget *emailsWidget = reinterpret_cast<QTreeWidgetItem *>(emailItemPointers.first())->treeWidget();
+        // Find the rows of all the dropped items in a single pass
+        QVector<int> rows;
+        rows.reserve(emailItems.size());
+        for (int row = 0; row < emailsWidget->topLevelItemCount(); ++row) {
+            if (emailItems.contains(emailsWidget->topLevelItem(row)))
+                rows.append(row);
         }
+        removeSortedRows(sourceFolder->emails, emailsWidget->model(), rows);
     }
 
-    updateCounts();
+    // Only these two changed, no need to go through all the folders
+    updateCount(sourceFolder);
+    updateCount(destFolder);
 
     return false;
 }
@@ -124,11 +157,22 @@ private:
 void EmailsTreeWidget::fillEmailsList(EmailFolder &folder)
 {
     m_folder = &folder;
-    clear();
-    for (const QString &email : folder.emails) {
+    clearSelection();
+    // Rather than clear() and creating new items, reuse the items of the previous folder
+    const int emailCount = folder.emails.size();
+    if (topLevelItemCount() > emailCount)
+        model()->removeRows(emailCount, topLevelItemCount() - emailCount); // in one go
+    const int reusedCount = topLevelItemCount();
+    for (int row = 0; row < reusedCount; ++row)
+        topLevelItem(row)->setText(0, folder.emails.at(row));
+    QList<QTreeWidgetItem *> newItems;
+    newItems.reserve(emailCount - reusedCount);
+    for (int row = reusedCount; row < emailCount; ++row) {
         // QTreeWidgetItem has ItemIsDragEnabled and ItemIsDropEnabled set by default
-        addTopLevelItem(new QTreeWidgetItem({email}));
+        newItems.append(new QTreeWidgetItem({folder.emails.at(row)}));
     }
+    addTopLevelItems(newItems); // a single row insertion
+    scrollToTop();
     header()->resizeSections(QHeaderView::ResizeToContents);
 }
 
@@ -162,7 +206,8 @@ QMimeData *EmailsTreeWidget::mimeData(const QList<QTreeWidgetItem *> items) cons
 class TopLevel : public QWidget
 {
 public:
-    TopLevel();
+    // Shows `emails`, or the built-in data if empty
+    explicit TopLevel(const EmailFolders &emails = EmailFolders());
 
 private:
     void fillFoldersTreeWidget(QTreeWidget *foldersTreeWidget);
@@ -188,9 +233,12 @@ void TopLevel::fillFoldersTreeWidget(QTreeWidget *foldersTreeWidget)
     }
 }
 
-TopLevel::TopLevel()
+TopLevel::TopLevel(const EmailFolders &emails)
     : QWidget(nullptr)
 {
+    if (!emails.isEmpty())
+        m_emails = emails;
+
     auto layout = new QHBoxLayout(this);
 
     // Drop side (left)
@@ -241,15 +289,31 @@ TopLevel::TopLevel()
     });
 }
 
+// The benchmarks include this file, with their own main()
+#ifndef DND_BENCHMARK
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
-    auto topLevel = new TopLevel();
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.folders, syntheticDataOptions.emailsPerFolder, syntheticDataOptions.seed});
+    parser.process(app);
+
+    EmailFolders emails;
+    if (parser.isSet(syntheticDataOptions.folders)) {
+        // Folder sizes follow Zipf's law: a few huge folders, and many small ones
+        SyntheticData generator(SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+        emails = generator.emailFolders<EmailFolders>(SyntheticDataOptions::intValue(parser, syntheticDataOptions.folders),
+                                                      SyntheticDataOptions::intValue(parser, syntheticDataOptions.emailsPerFolder));
+    }
+
+    auto topLevel = new TopLevel(emails);
     topLevel->resize(700, 400);
     topLevel->show();
     topLevel->setAttribute(Qt::WA_DeleteOnClose);
 
     return app.exec();
 }
-
+#endif
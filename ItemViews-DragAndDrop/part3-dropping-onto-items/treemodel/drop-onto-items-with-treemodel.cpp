@@ -6,44 +6,569 @@
 */
 
 #include "check-index.h"
+#include "model-instrumentation.h"
+#include "synthetic-data.h"
 #include <QAbstractItemModel>
 #include <QAbstractItemModelTester>
 #include <QApplication>
+#include <QCheckBox>
+#include <QCommandLineParser>
+#include <QDateTime>
 #include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QHBoxLayout>
 #include <QHeaderView>
 #include <QIODevice>
+#include <QInputDialog>
+#include <QItemSelectionModel>
+#include <QLineEdit>
+#include <QLocale>
+#include <QMenu>
+#include <QMessageBox>
 #include <QMimeData>
+#include <QMutex>
+#include <QSaveFile>
+#include <QSet>
+#include <QSortFilterProxyModel>
+#include <QtConcurrentRun>
+#include <QStringView>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
 #include <QTreeView>
+#include <QVBoxLayout>
 #include <QVector>
 #include <QWidget>
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include <io.h> // _commit
+#else
+#include <unistd.h> // fsync
+#endif
+
+// Decodes the "encoded words" of email headers (RFC 2047), e.g. "=?UTF-8?B?w4l0w6k=?=".
+// `header` holds the raw bytes of the header, as Latin-1. Only UTF-8 and Latin-1 (and thus ASCII)
+// charsets are supported; other charsets, and unencoded 8-bit text, are assumed to be UTF-8.
+static QString decodeHeader(QStringView header)
+{
+    QString result;
+    qsizetype pos = 0;
+    bool previousWasEncoded = false;
+    while (pos < header.size()) {
+        const qsizetype start = header.indexOf(QLatin1String("=?"), pos);
+        const qsizetype charsetEnd = start < 0 ? -1 : header.indexOf(QLatin1Char('?'), start + 2);
+        const qsizetype end = charsetEnd < 0 ? -1 : header.indexOf(QLatin1String("?="), charsetEnd + 3);
+        if (end < 0 || header.at(charsetEnd + 2) != QLatin1Char('?')) {
+            result += QString::fromUtf8(header.mid(pos).toLatin1());
+            break;
+        }
+        const QStringView text = header.mid(pos, start - pos);
+        // Whitespace between two encoded words is ignored
+        if (!previousWasEncoded || !text.trimmed().isEmpty())
+            result += QString::fromUtf8(text.toLatin1());
+
+        const QStringView charset = header.mid(start + 2, charsetEnd - start - 2);
+        const QChar encoding = header.at(charsetEnd + 1).toUpper();
+        QByteArray encodedText = header.mid(charsetEnd + 3, end - charsetEnd - 3).toLatin1();
+        QByteArray decodedText;
+        if (encoding == QLatin1Char('B')) {
+            decodedText = QByteArray::fromBase64(encodedText);
+        } else {
+            encodedText.replace('_', ' ');
+            decodedText = QByteArray::fromPercentEncoding(encodedText, '=');
+        }
+        const bool isLatin1 = charset.compare(QLatin1String("iso-8859-1"), Qt::CaseInsensitive) == 0;
+        result += isLatin1 ? QString::fromLatin1(decodedText) : QString::fromUtf8(decodedText);
+        previousWasEncoded = true;
+        pos = end + 2;
+    }
+    return result;
+}
+
+// All the emails, whatever folder they are in. Folders only store email IDs, i.e. indexes in this store.
+// The fields are stored column by column rather than as one struct per email: sorting a million emails
+// by date only reads the 8MB array of dates, and the strings of all emails are kept in one buffer,
+// instead of two allocations per email. Emails are never modified or removed from the store,
+// so an ID remains valid as long as the store exists.
+class EmailStore
+{
+public:
+    enum Flag : quint64 {
+        NoFlags = 0x0,
+        Unread = 0x1,
+        Flagged = 0x2,
+        HasAttachment = 0x4,
+        // The subject is stored as found in the email header, and only decoded by displaySubject().
+        // This makes loading faster, when only a fraction of the subjects will ever be looked at.
+        RawSubject = 0x100,
+    };
+
+    // `date` is in milliseconds since the epoch, `size` in bytes. `location` says where the email is stored,
+    // if not only in memory (see MaildirBackend). Returns the ID of the new email.
+    int addEmail(const QString &subject, const QString &sender, qint64 date, qint64 size, quint64 flags = NoFlags,
+                 const QString &location = QString())
+    {
+        m_subjects.push_back(addString(subject));
+        m_senders.push_back(internString(sender));
+        m_locations.push_back(addString(location));
+        m_dates.push_back(date);
+        m_sizes.push_back(size);
+        m_flags.push_back(flags);
+        m_subjectSortKeys.emplace_back(); // see subjectSortKey()
+        return int(m_dates.size()) - 1;
+    }
+
+    int count() const { return int(m_dates.size()); }
+
+    // Appends all the emails of `other`, and returns the offset to add to their IDs in `other`
+    int append(const EmailStore &other)
+    {
+        const int idOffset = count();
+        const int stringOffset = int(m_stringPool.size());
+        const auto shifted = [stringOffset](StringRef ref) { return StringRef{stringOffset + ref.offset, ref.length}; };
+        m_stringPool += other.m_stringPool;
+        for (auto it = other.m_internedStrings.cbegin(); it != other.m_internedStrings.cend(); ++it) {
+            if (!m_internedStrings.contains(it.key()))
+                m_internedStrings.insert(it.key(), shifted(it.value()));
+        }
+        std::transform(other.m_subjects.cbegin(), other.m_subjects.cend(), std::back_inserter(m_subjects), shifted);
+        std::transform(other.m_senders.cbegin(), other.m_senders.cend(), std::back_inserter(m_senders), shifted);
+        std::transform(other.m_locations.cbegin(), other.m_locations.cend(), std::back_inserter(m_locations), shifted);
+        m_dates.insert(m_dates.end(), other.m_dates.cbegin(), other.m_dates.cend());
+        m_sizes.insert(m_sizes.end(), other.m_sizes.cbegin(), other.m_sizes.cend());
+        m_flags.insert(m_flags.end(), other.m_flags.cbegin(), other.m_flags.cend());
+        m_subjectSortKeys.insert(m_subjectSortKeys.end(), other.m_subjectSortKeys.cbegin(), other.m_subjectSortKeys.cend());
+        return idOffset;
+    }
+
+    QStringView subject(int id) const { return stringAt(m_subjects.at(id)); } // see RawSubject
+    QString displaySubject(int id) const
+    {
+        return (flags(id) & RawSubject) ? decodeHeader(subject(id)) : subject(id).toString();
+    }
+    // The decoded subject, case-folded, for sorting and filtering without decoding it on every comparison
+    // (sorting n emails compares O(n log n) times). Computed the first time it's needed, and then kept:
+    // only a fraction of the emails are ever sorted, or even looked at.
+    // Only for the GUI thread, unlike the other getters.
+    const QString &subjectSortKey(int id) const
+    {
+        QString &key = m_subjectSortKeys.at(id); // never resized here, so references to other keys remain valid
+        if (key.isNull()) {
+            key = displaySubject(id).toCaseFolded();
+            if (key.isNull())
+                key = QLatin1String(""); // computed, even if empty
+        }
+        return key;
+    }
+    QStringView sender(int id) const { return stringAt(m_senders.at(id)); }
+    qint64 date(int id) const { return m_dates.at(id); }
+    qint64 size(int id) const { return m_sizes.at(id); }
+    quint64 flags(int id) const { return m_flags.at(id); }
+    QStringView location(int id) const { return stringAt(m_locations.at(id)); }
+
+private:
+    struct StringRef
+    {
+        int offset; // in m_stringPool
+        int length;
+    };
+
+    StringRef addString(const QString &str)
+    {
+        const StringRef ref{int(m_stringPool.size()), int(str.size())};
+        m_stringPool += str;
+        return ref;
+    }
+
+    // The same senders appear over and over, store each of them only once
+    StringRef internString(const QString &str)
+    {
+        const auto it = m_internedStrings.constFind(str);
+        if (it != m_internedStrings.cend())
+            return *it;
+        const StringRef ref = addString(str);
+        m_internedStrings.insert(str, ref);
+        return ref;
+    }
+
+    QStringView stringAt(StringRef ref) const { return QStringView(m_stringPool).mid(ref.offset, ref.length); }
+
+    QString m_stringPool;
+    QHash<QString, StringRef> m_internedStrings;
+    std::vector<StringRef> m_subjects;
+    std::vector<StringRef> m_senders;
+    std::vector<StringRef> m_locations;
+    std::vector<qint64> m_dates;
+    std::vector<qint64> m_sizes;
+    std::vector<quint64> m_flags;
+    mutable std::vector<QString> m_subjectSortKeys; // null until computed
+};
+
 struct EmailFolder
 {
     QString folderName;
-    QVector<EmailFolder> subFolders;
-    QStringList emails;
+    // Each folder is allocated separately, so that its address never changes:
+    // it's used as internal pointer in model indexes, as parentFolder in its subfolders, etc.
+    // With a QVector<EmailFolder>, adding a folder could reallocate all its siblings.
+    std::vector<std::unique_ptr<EmailFolder>> subFolders;
+    QVector<int> emails; // IDs in the EmailStore
     EmailFolder *parentFolder = nullptr;
+    int row = 0; // position in parentFolder->subFolders, cached so that FoldersModel::parent() is O(1)
+    int totalEmails = 0; // number of emails in this folder and all its subfolders, maintained by FoldersModel
+    int id = -1; // unique, assigned by FoldersModel
+    bool subFoldersLoading = false; // see EmailFolderLoader
 };
 
-using EmailFolders = QVector<EmailFolder>;
+static EmailFolder *appendFolder(EmailFolder &parentFolder, const QString &folderName, const QVector<int> &emails = {})
+{
+    auto folder = std::make_unique<EmailFolder>();
+    folder->folderName = folderName;
+    folder->emails = emails;
+    folder->parentFolder = &parentFolder;
+    folder->row = int(parentFolder.subFolders.size());
+    parentFolder.subFolders.push_back(std::move(folder));
+    return parentFolder.subFolders.back().get();
+}
+
+// Updates the cached rows of `folders`, from the first one which moved
+static void updateRows(std::vector<std::unique_ptr<EmailFolder>> &folders, int from)
+{
+    for (int i = from; i < int(folders.size()); ++i)
+        folders.at(i)->row = i;
+}
+
+static bool isSameOrDescendant(const EmailFolder *folder, const EmailFolder *ancestor)
+{
+    for (; folder; folder = folder->parentFolder) {
+        if (folder == ancestor)
+            return true;
+    }
+    return false;
+}
+
+static const char s_emailsMimeType[] = "application/x-email-ids";
+static const char s_foldersMimeType[] = "application/x-email-folder-ids";
+static const char s_emailLocationsMimeType[] = "application/x-email-locations"; // (folder ID, email ID) pairs
+
+// Full-text search in all the emails, whatever folder they are in.
+// Each word of the subjects and senders (lowercased) is mapped to the IDs of the emails containing it,
+// and each email ID to the IDs of the folders containing that email. Looking up a query is then a
+// binary search per word plus the size of the results, rather than scanning every email of every
+// folder on each keystroke. Locations are stored as folder IDs rather than rows, so that they don't
+// change when other emails are removed from the same folder.
+// The initial indexing runs in a background thread. Changes reported meanwhile are queued,
+// and applied once it's done.
+class EmailIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Location
+    {
+        int emailId;
+        int folderId;
+    };
+
+    explicit EmailIndex(const EmailStore *emailStore, QObject *parent = nullptr)
+        : QObject(parent)
+        , m_emailStore(emailStore)
+    {
+        connect(&m_buildWatcher, &QFutureWatcher<std::shared_ptr<Data>>::finished, this, &EmailIndex::buildFinished);
+    }
+
+    // The indexing thread reads the EmailStore, which is about to be deleted too (e.g. when closing the window)
+    ~EmailIndex() override { m_buildWatcher.waitForFinished(); }
+
+    // Indexes all the emails of the store, and the folders under `rootFolder`.
+    // The store must not be modified until changed() is emitted, since it's read from another thread.
+    void build(const EmailFolder *rootFolder)
+    {
+        // Implicitly shared copies of the email lists: cheap to make, and the thread
+        // isn't affected when the GUI thread modifies the folders meanwhile
+        const QVector<FolderEmails> folders = collectFolders(rootFolder);
+        const EmailStore *emailStore = m_emailStore;
+        const int emailCount = emailStore->count();
+        m_ready = false;
+        m_pendingChanges.clear();
+        m_buildWatcher.setFuture(QtConcurrent::run([emailStore, emailCount, folders] {
+            auto data = std::make_shared<Data>();
+            for (int emailId = 0; emailId < emailCount; ++emailId)
+                indexEmail(*data, *emailStore, emailId);
+            for (const FolderEmails &folder : folders) {
+                for (int emailId : folder.emailIds)
+                    data->folderIds.insert(emailId, folder.folderId);
+            }
+            return data;
+        }));
+    }
+
+    bool isReady() const { return m_ready; }
+
+    // To be called after `count` emails were appended to `folder`
+    void addEmails(const EmailFolder *folder, int count)
+    {
+        applyOrQueue({folder->id, folder->emails.mid(folder->emails.size() - count), true});
+    }
+
+    // To be called before emails are removed from `folder`
+    void removeEmails(const EmailFolder *folder, int row, int count)
+    {
+        applyOrQueue({folder->id, folder->emails.mid(row, count), false});
+    }
+
+    // To be called before `folder` and its subfolders are deleted
+    void removeFolder(const EmailFolder *folder)
+    {
+        const QVector<FolderEmails> folders = collectFolders(folder);
+        for (const FolderEmails &removedFolder : folders)
+            applyOrQueue({removedFolder.folderId, removedFolder.emailIds, false});
+    }
+
+    // The emails containing all the words of `query`, in each folder where they are.
+    // The last word can be incomplete, since this is called as the user types:
+    // it matches all the words that start with it. Except when it's shorter than s_minPrefixLength:
+    // "a" would match a good part of the vocabulary, and merging all those lists on each keystroke
+    // costs more than the search is worth at that point. So short words only match whole words.
+    QVector<Location> search(const QString &query) const
+    {
+        QStringList words;
+        forEachWord(query, [&words](const QString &word) { words.append(word); });
+        if (!m_ready || words.isEmpty())
+            return {};
+
+        std::vector<int> emailIds;
+        for (int i = 0; i < words.size(); ++i) {
+            const bool isPrefix = i == words.size() - 1 && words.at(i).size() >= s_minPrefixLength;
+            std::vector<int> matches = isPrefix ? prefixMatches(words.at(i)) : exactMatches(words.at(i));
+            if (i == 0) {
+                emailIds = std::move(matches);
+            } else {
+                std::vector<int> intersection;
+                std::set_intersection(emailIds.cbegin(), emailIds.cend(), matches.cbegin(), matches.cend(), std::back_inserter(intersection));
+                emailIds = std::move(intersection);
+            }
+            if (emailIds.empty())
+                return {};
+        }
+
+        QVector<Location> locations;
+        for (int emailId : emailIds) {
+            for (auto it = m_data->folderIds.constFind(emailId); it != m_data->folderIds.cend() && it.key() == emailId; ++it)
+                locations.append({emailId, it.value()});
+        }
+        return locations;
+    }
+
+signals:
+    // Emitted when the initial indexing is done, and after every change
+    void changed();
+
+private:
+    static constexpr int s_minPrefixLength = 3;
+
+    struct Data
+    {
+        std::map<QString, std::vector<int>> emailIdsByWord; // sorted by word (for prefix matches), then by email ID
+        QMultiHash<int, int> folderIds; // by email ID: an email can be in several folders, if copied
+    };
+
+    struct FolderEmails
+    {
+        int folderId;
+        QVector<int> emailIds;
+    };
+
+    struct Change
+    {
+        int folderId;
+        QVector<int> emailIds;
+        bool added;
+    };
+
+    template<typename Callback>
+    static void forEachWord(QStringView text, Callback callback)
+    {
+        qsizetype start = -1;
+        for (qsizetype i = 0; i <= text.size(); ++i) {
+            const bool inWord = i < text.size() && text.at(i).isLetterOrNumber();
+            if (inWord && start < 0) {
+                start = i;
+            } else if (!inWord && start >= 0) {
+                callback(text.mid(start, i - start).toString().toLower());
+                start = -1;
+            }
+        }
+    }
+
+    static void indexEmail(Data &data, const EmailStore &emailStore, int emailId)
+    {
+        const auto addWord = [&data, emailId](const QString &word) {
+            std::vector<int> &emailIds = data.emailIdsByWord[word];
+            if (emailIds.empty() || emailIds.back() != emailId) // the same word can appear twice in an email
+                emailIds.push_back(emailId);
+        };
+        forEachWord(emailStore.displaySubject(emailId), addWord);
+        forEachWord(emailStore.sender(emailId), addWord);
+    }
+
+    static QVector<FolderEmails> collectFolders(const EmailFolder *folder)
+    {
+        QVector<FolderEmails> folders;
+        const auto collect = [&folders](const EmailFolder *folder, const auto &collect) -> void {
+            folders.append({folder->id, folder->emails});
+            for (const auto &childFolder : folder->subFolders)
+                collect(childFolder.get(), collect);
+        };
+        collect(folder, collect);
+        return folders;
+    }
+
+    std::vector<int> exactMatches(const QString &word) const
+    {
+        const auto it = m_data->emailIdsByWord.find(word);
+        return it == m_data->emailIdsByWord.cend() ? std::vector<int>() : it->second;
+    }
+
+    std::vector<int> prefixMatches(const QString &prefix) const
+    {
+        std::vector<int> emailIds;
+        int matchingWords = 0;
+        for (auto it = m_data->emailIdsByWord.lower_bound(prefix); it != m_data->emailIdsByWord.cend() && it->first.startsWith(prefix); ++it) {
+            emailIds.insert(emailIds.end(), it->second.cbegin(), it->second.cend());
+            ++matchingWords;
+        }
+        if (matchingWords > 1) { // merge the (sorted) lists of each word
+            std::sort(emailIds.begin(), emailIds.end());
+            emailIds.erase(std::unique(emailIds.begin(), emailIds.end()), emailIds.end());
+        }
+        return emailIds;
+    }
+
+    void applyOrQueue(Change change)
+    {
+        if (!m_ready) {
+            m_pendingChanges.push_back(std::move(change));
+            return;
+        }
+        apply(change);
+        emit changed();
+    }
+
+    void apply(const Change &change)
+    {
+        for (int emailId : change.emailIds) {
+            if (change.added) {
+                m_data->folderIds.insert(emailId, change.folderId);
+            } else {
+                const auto it = m_data->folderIds.find(emailId, change.folderId);
+                if (it != m_data->folderIds.end())
+                    m_data->folderIds.erase(it);
+            }
+        }
+    }
+
+    void buildFinished()
+    {
+        m_data = m_buildWatcher.result();
+        for (const Change &change : m_pendingChanges)
+            apply(change);
+        m_pendingChanges.clear();
+        m_ready = true;
+        emit changed();
+    }
 
-static const char s_emailsMimeType[] = "application/x-emails-list";
+    const EmailStore *m_emailStore;
+    std::shared_ptr<Data> m_data;
+    bool m_ready = false;
+    std::vector<Change> m_pendingChanges; // while building
+    QFutureWatcher<std::shared_ptr<Data>> m_buildWatcher;
+};
 
 // "Drag" model
-class EmailsModel : public QAbstractListModel
+class EmailsModel : public QAbstractTableModel
 {
+    Q_OBJECT
+
 public:
-    // Like a QStringListModel, but with custom mimeData() so we can decode it
+    // Shows the emails of one folder, with custom mimeData() so we can decode it
     explicit EmailsModel(QObject *parent = nullptr)
-        : QAbstractListModel(parent)
+        : QAbstractTableModel(parent)
     {
     }
 
-    void setEmails(EmailFolder *folder) {
-        beginResetModel();
-        m_emailFolder = folder;
-        endResetModel();
+    enum Columns { Subject, Sender, Date, Size, Flags, COLUMNCOUNT };
+
+    // Must be called before setEmails()
+    void setEmailStore(const EmailStore *emailStore) { m_emailStore = emailStore; }
+    const EmailStore *emailStore() const { return m_emailStore; }
+
+    // Shows the emails of `folder`.
+    // Moving emails leaves them in a single folder, so two folders usually have no emails in common:
+    // then the model is simply reset, and TopLevel::showFolder() restores the selection and scroll position
+    // the views had for that folder. When they do have emails in common (e.g. after copying emails),
+    // resetting would make the views forget which emails were selected: instead, the runs of rows which
+    // aren't in the new folder are removed, and the runs of new ones inserted, as long as the common
+    // emails are in the same order in both folders.
+    // Calling this again for the current folder announces the emails appended since notifyEmailsAppended(),
+    // and that the other rows changed, since the model can't know which ones.
+    void setEmails(EmailFolder *folder)
+    {
+        if (folder == m_emailFolder) {
+            refreshEmails();
+        } else if (!m_emailFolder || !folder || !diffEmails(folder)) {
+            beginResetModel();
+            m_emailFolder = folder;
+            m_emails = folder ? &folder->emails : nullptr;
+            m_rowCount = folder ? int(folder->emails.size()) : 0;
+            endResetModel();
+        }
+    }
+
+    EmailFolder *emailFolder() const { return m_emailFolder; }
+
+    // For EmailsProxyModel, to get to the data without going through QVariant
+    int emailId(int row) const { return m_emails->at(row < m_gapRow ? row : row + m_gapSize); }
+
+    // The rows of the emails among `ids` which are shown, by email ID, e.g. to restore a selection. O(rows).
+    QHash<int, int> rowsForEmails(const QSet<int> &ids) const
+    {
+        QHash<int, int> rows;
+        rows.reserve(ids.size());
+        for (int row = 0; row < m_rowCount && rows.size() < ids.size(); ++row) {
+            const int id = emailId(row);
+            if (ids.contains(id))
+                rows.insert(id, row);
+        }
+        return rows;
+    }
+
+    // To be called after emails were appended to `folder`.
+    // If it's the folder being shown, the new emails are announced as a single range of inserted
+    // rows, so that the views just lay out the new rows rather than everything.
+    void notifyEmailsAppended(EmailFolder *folder)
+    {
+        // (The `count` argument of FoldersModel::emailsAppended isn't needed, we know how many rows the views have seen)
+        if (folder != m_emailFolder)
+            return;
+        const int newCount = int(folder->emails.size());
+        if (newCount > m_rowCount) {
+            beginInsertRows(QModelIndex(), m_rowCount, newCount - 1);
+            m_rowCount = newCount;
+            endInsertRows();
+        }
     }
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override
@@ -51,7 +576,15 @@ public:
         CHECK_rowCount(parent);
         if (parent.isValid())
             return 0; // flat model
-        return m_emailFolder->emails.size();
+        return m_rowCount;
+    }
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        CHECK_columnCount(parent);
+        if (parent.isValid())
+            return 0;
+        return COLUMNCOUNT;
     }
 
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
@@ -60,7 +593,20 @@ public:
         if (!index.isValid() || role != Qt::DisplayRole)
             return QVariant();
 
-        return m_emailFolder->emails.at(index.row());
+        const int id = emailId(index.row());
+        switch (index.column()) {
+        case Subject:
+            return m_emailStore->displaySubject(id);
+        case Sender:
+            return m_emailStore->sender(id).toString();
+        case Date:
+            return QDateTime::fromMSecsSinceEpoch(m_emailStore->date(id)).toString("yyyy-MM-dd hh:mm");
+        case Size:
+            return QLocale().formattedDataSize(m_emailStore->size(id));
+        case Flags:
+            return flagsText(m_emailStore->flags(id));
+        }
+        return QVariant();
     }
 
     Qt::ItemFlags flags(const QModelIndex &index) const override
@@ -73,23 +619,55 @@ public:
 
     QVariant headerData(int section, Qt::Orientation orientation, int role) const override
     {
-        // CHECK_headerData(section, orientation); doesn't built, columnCount is private...
-        if (orientation == Qt::Horizontal && section == 0)
-            return "Emails";
+        CHECK_headerData(section, orientation);
+        if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+            switch (section) {
+            case Subject:
+                return "Subject";
+            case Sender:
+                return "From";
+            case Date:
+                return "Date";
+            case Size:
+                return "Size";
+            case Flags:
+                return "Flags";
+            }
+        }
         return {};
     }
 
     bool removeRows(int position, int rows, const QModelIndex &parent) override
     {
         CHECK_removeRows(position, rows, parent);
+        emit emailsAboutToBeRemoved(m_emailFolder, position, rows);
         beginRemoveRows(parent, position, position + rows - 1);
-        for (int row = 0; row < rows; ++row) {
-            m_emailFolder->emails.removeAt(position);
-        }
+        m_emailFolder->emails.remove(position, rows);
+        m_rowCount -= rows;
         endRemoveRows();
+        emit emailsRemoved(m_emailFolder, position, rows);
         return true;
     }
 
+    // To be called by FoldersModel::emailsAboutToBeRemoved and FoldersModel::emailsRemoved,
+    // when emails are removed from a folder without going through removeRows()
+    void notifyEmailsAboutToBeRemoved(EmailFolder *folder, int row, int count)
+    {
+        if (folder != m_emailFolder)
+            return;
+        Q_ASSERT(row + count <= m_rowCount);
+        beginRemoveRows(QModelIndex(), row, row + count - 1);
+    }
+
+    void notifyEmailsRemoved(EmailFolder *folder, int row, int count)
+    {
+        Q_UNUSED(row);
+        if (folder != m_emailFolder)
+            return;
+        m_rowCount -= count;
+        endRemoveRows();
+    }
+
     // the default is "copy only", change it
     Qt::DropActions supportedDragActions() const override { return Qt::MoveAction | Qt::CopyAction; }
 
@@ -99,16 +677,16 @@ public:
         QByteArray encodedData;
         QDataStream stream(&encodedData, QIODevice::WriteOnly);
 
-        // Serialize source folder name (to detect dropping onto the same folder)
-        stream << m_emailFolder->folderName;
+        // Serialize source folder ID (to detect dropping onto the same folder)
+        stream << m_emailFolder->id;
 
-        // Serialize email contents
+        // Serialize the email IDs: the emails themselves stay in the EmailStore
         for (const QModelIndex &index : indexes) {
             const int row = index.row();
             // Note that with QTreeView, this is called for every column => deduplicate
             if (!seenRows.contains(row)) {
                 seenRows.insert(row);
-                stream << m_emailFolder->emails.at(row);
+                stream << emailId(row);
             }
         }
 
@@ -117,8 +695,205 @@ public:
         return mimeData;
     }
 
+signals:
+    // So that FoldersModel can update its counts, and EmailIndex its locations
+    void emailsAboutToBeRemoved(EmailFolder *folder, int row, int count);
+    void emailsRemoved(EmailFolder *folder, int row, int count);
+
 private:
+    static QString flagsText(quint64 flags)
+    {
+        QStringList texts;
+        if (flags & EmailStore::Unread)
+            texts.append("Unread");
+        if (flags & EmailStore::Flagged)
+            texts.append("Flagged");
+        if (flags & EmailStore::HasAttachment)
+            texts.append("Attachment");
+        return texts.join(", ");
+    }
+
+    void refreshEmails()
+    {
+        const int oldCount = m_rowCount;
+        const int newCount = m_emailFolder ? int(m_emailFolder->emails.size()) : 0;
+        if (newCount < oldCount) {
+            beginRemoveRows(QModelIndex(), newCount, oldCount - 1);
+            m_rowCount = newCount;
+            endRemoveRows();
+        }
+        const int commonCount = std::min(oldCount, newCount);
+        if (commonCount > 0)
+            emit dataChanged(index(0, 0), index(commonCount - 1, COLUMNCOUNT - 1), {Qt::DisplayRole});
+        if (newCount > oldCount) {
+            beginInsertRows(QModelIndex(), oldCount, newCount - 1);
+            m_rowCount = newCount;
+            endInsertRows();
+        }
+    }
+
+    // Switches from m_emailFolder to `folder` by removing and inserting runs of rows.
+    // Returns false, without changing anything, if the folders have no emails in common, or not in the same order.
+    // The views see each intermediate state, so the rows go through a buffer with a gap in the middle
+    // (see emailId()): the gap moves forward over the rows as the runs are removed, then again as the runs
+    // are inserted, and each email is copied once per pass. O(old rows + new rows), whatever the number of runs.
+    bool diffEmails(EmailFolder *folder)
+    {
+        const QVector<int> &newEmails = folder->emails;
+        QHash<int, int> oldRows; // by email ID, for the rows the views know about
+        oldRows.reserve(m_rowCount);
+        for (int row = 0; row < m_rowCount; ++row)
+            oldRows.insert(m_emails->at(row), row);
+        std::vector<bool> keptRows(m_rowCount, false);
+        int lastKeptRow = -1;
+        int keptCount = 0;
+        for (int id : newEmails) {
+            const auto it = oldRows.constFind(id);
+            if (it == oldRows.cend())
+                continue;
+            if (it.value() <= lastKeptRow)
+                return false; // in another order, this would need moves
+            lastKeptRow = it.value();
+            keptRows[lastKeptRow] = true;
+            ++keptCount;
+        }
+        if (lastKeptRow < 0)
+            return false;
+
+        // Removing: the rows before the gap are the kept ones, the rows after it the old ones not looked at yet
+        const int oldCount = m_rowCount;
+        QVector<int> buffer = m_emails->mid(0, oldCount);
+        m_emails = &buffer;
+        for (int oldRow = 0; oldRow < oldCount;) {
+            if (keptRows.at(oldRow)) {
+                buffer[m_gapRow] = buffer.at(oldRow); // from after the gap to before it, the row doesn't move
+                ++m_gapRow;
+                ++oldRow;
+                continue;
+            }
+            const int firstOldRow = oldRow;
+            while (oldRow < oldCount && !keptRows.at(oldRow))
+                ++oldRow;
+            const int count = oldRow - firstOldRow;
+            beginRemoveRows(QModelIndex(), m_gapRow, m_gapRow + count - 1);
+            m_gapSize += count;
+            m_rowCount -= count;
+            endRemoveRows();
+        }
+        Q_ASSERT(m_rowCount == keptCount);
+
+        // Inserting: the kept rows move to the end of a buffer of the new size, and the gap goes back to the start.
+        // Then the rows before the gap are the new rows, and the rows after it the kept ones not looked at yet.
+        const int newCount = int(newEmails.size());
+        QVector<int> newBuffer(newCount);
+        std::copy(buffer.cbegin(), buffer.cbegin() + keptCount, newBuffer.end() - keptCount);
+        m_emails = &newBuffer;
+        m_gapRow = 0;
+        m_gapSize = newCount - keptCount;
+        buffer = QVector<int>();
+        for (int row = 0; row < newCount;) {
+            if (oldRows.contains(newEmails.at(row))) {
+                Q_ASSERT(newBuffer.at(row + m_gapSize) == newEmails.at(row));
+                newBuffer[row] = newBuffer.at(row + m_gapSize);
+                ++m_gapRow;
+                ++row;
+                continue;
+            }
+            const int firstRow = row;
+            while (row < newCount && !oldRows.contains(newEmails.at(row)))
+                ++row;
+            const int count = row - firstRow;
+            beginInsertRows(QModelIndex(), firstRow, row - 1);
+            std::copy(newEmails.cbegin() + firstRow, newEmails.cbegin() + row, newBuffer.begin() + firstRow);
+            m_gapRow += count;
+            m_gapSize -= count;
+            m_rowCount += count;
+            endInsertRows();
+        }
+        Q_ASSERT(m_gapSize == 0 && newBuffer == newEmails);
+        m_gapRow = 0;
+        m_emailFolder = folder;
+        m_emails = &folder->emails;
+        return true;
+    }
+
+    const EmailStore *m_emailStore = nullptr;
     EmailFolder *m_emailFolder = nullptr;
+    const QVector<int> *m_emails = nullptr; // m_emailFolder's, except while diffEmails() goes from one folder to the next
+    // While diffEmails() runs, the rows from m_gapRow on are m_gapSize entries further in m_emails
+    int m_gapRow = 0;
+    int m_gapSize = 0;
+    // The number of rows the views know about. Emails appended to the folder only show up
+    // when calling notifyEmailsAppended(), or setEmails() again.
+    int m_rowCount = 0;
+};
+
+// Sorting and filtering for the emails view.
+// Rather than comparing the QVariants returned by data(), which would mean formatting dates and sizes
+// as strings for every comparison, this reads the packed arrays of the EmailStore directly.
+class EmailsProxyModel : public QSortFilterProxyModel
+{
+public:
+    explicit EmailsProxyModel(EmailsModel *emailsModel, QObject *parent = nullptr)
+        : QSortFilterProxyModel(parent)
+        , m_emailsModel(emailsModel)
+    {
+        setSourceModel(emailsModel);
+    }
+
+    // Only show emails which have all these flags
+    void setRequiredFlags(quint64 flags)
+    {
+        m_requiredFlags = flags;
+        invalidateFilter();
+    }
+
+    // Only show emails whose subject or sender contains this text
+    void setSearchText(const QString &text)
+    {
+        m_searchText = text;
+        invalidateFilter();
+    }
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override
+    {
+        Q_UNUSED(sourceParent);
+        const EmailStore *store = m_emailsModel->emailStore();
+        const int id = m_emailsModel->emailId(sourceRow);
+        if ((store->flags(id) & m_requiredFlags) != m_requiredFlags)
+            return false;
+        if (m_searchText.isEmpty() || store->sender(id).contains(m_searchText, Qt::CaseInsensitive))
+            return true;
+        if (store->flags(id) & EmailStore::RawSubject)
+            return store->subjectSortKey(id).contains(m_searchText, Qt::CaseInsensitive); // decoded once, not per keystroke
+        return store->subject(id).contains(m_searchText, Qt::CaseInsensitive);
+    }
+
+    bool lessThan(const QModelIndex &left, const QModelIndex &right) const override
+    {
+        const EmailStore *store = m_emailsModel->emailStore();
+        const int leftId = m_emailsModel->emailId(left.row());
+        const int rightId = m_emailsModel->emailId(right.row());
+        switch (left.column()) {
+        case EmailsModel::Subject:
+            return store->subjectSortKey(leftId) < store->subjectSortKey(rightId);
+        case EmailsModel::Sender:
+            return store->sender(leftId).compare(store->sender(rightId), Qt::CaseInsensitive) < 0;
+        case EmailsModel::Date:
+            return store->date(leftId) < store->date(rightId);
+        case EmailsModel::Size:
+            return store->size(leftId) < store->size(rightId);
+        case EmailsModel::Flags:
+            return store->flags(leftId) < store->flags(rightId);
+        }
+        return false;
+    }
+
+private:
+    EmailsModel *m_emailsModel;
+    quint64 m_requiredFlags = EmailStore::NoFlags;
+    QString m_searchText;
 };
 
 // "Drop" model
@@ -129,16 +904,23 @@ class FoldersModel : public QAbstractItemModel
 public:
     using QAbstractItemModel::QAbstractItemModel;
 
+    // Can be called again to replace all the folders; the previous ones can be deleted afterwards
     void setEmailFolders(EmailFolder *emailRootFolder)
     {
+        beginResetModel();
         m_emailRootFolder = emailRootFolder;
+        m_foldersById.clear();
+        registerFolders(m_emailRootFolder);
+        computeTotals(m_emailRootFolder);
+        endResetModel();
 #ifndef QT_NO_DEBUG
         // To catch errors during development
-        new QAbstractItemModelTester(this, QAbstractItemModelTester::FailureReportingMode::Fatal, this);
+        if (!findChild<QAbstractItemModelTester *>())
+            new QAbstractItemModelTester(this, QAbstractItemModelTester::FailureReportingMode::Fatal, this);
 #endif
     }
 
-    enum Columns { Folder, NumEmails, COLUMNCOUNT };
+    enum Columns { Folder, NumEmails, TotalEmails, COLUMNCOUNT };
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override
     {
@@ -147,7 +929,7 @@ public:
             return 0;
 
         auto parentFolder = folderForIndex(parent);
-        return parentFolder->subFolders.size();
+        return int(parentFolder->subFolders.size());
     }
 
     int columnCount(const QModelIndex &parent = QModelIndex()) const override
@@ -157,6 +939,50 @@ public:
         return COLUMNCOUNT;
     }
 
+    // Folders whose subfolders are still loading can be expanded, and expanding them
+    // asks for their subfolders to be loaded next (see subFoldersRequested)
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override
+    {
+        if (parent.column() > 0)
+            return false;
+        const EmailFolder *folder = folderForIndex(parent);
+        return !folder->subFolders.empty() || folder->subFoldersLoading;
+    }
+
+    bool canFetchMore(const QModelIndex &parent) const override
+    {
+        return parent.column() <= 0 && folderForIndex(parent)->subFoldersLoading;
+    }
+
+    void fetchMore(const QModelIndex &parent) override { emit subFoldersRequested(folderForIndex(parent)); }
+
+    // Adds the subfolders of `parentFolder` once they are loaded
+    void insertLoadedFolders(EmailFolder *parentFolder, std::vector<std::unique_ptr<EmailFolder>> folders)
+    {
+        parentFolder->subFoldersLoading = false;
+        if (folders.empty()) {
+            // No subfolders after all: hasChildren() is now false, the views must drop the expand arrow
+            if (parentFolder != m_emailRootFolder) {
+                const QModelIndex parentIndex = indexForFolder(parentFolder);
+                emit dataChanged(parentIndex, parentIndex);
+            }
+            return;
+        }
+        auto &siblings = parentFolder->subFolders;
+        const int firstRow = int(siblings.size());
+        int addedEmails = 0;
+        beginInsertRows(indexForFolder(parentFolder), firstRow, firstRow + int(folders.size()) - 1);
+        for (auto &folder : folders) {
+            folder->parentFolder = parentFolder;
+            folder->row = int(siblings.size());
+            registerFolders(folder.get());
+            addedEmails += computeTotals(folder.get());
+            siblings.push_back(std::move(folder));
+        }
+        endInsertRows();
+        addToTotals(parentFolder, addedEmails);
+    }
+
     QModelIndex index(int row, int column, const QModelIndex &parent) const override
     {
         CHECK_index(row, column, parent);
@@ -164,9 +990,7 @@ public:
             return {};
 
         auto parentFolder = folderForIndex(parent);
-        if (auto *childFolder = &parentFolder->subFolders.at(row))
-            return createIndex(row, column, const_cast<EmailFolder *>(childFolder)); // const_cast only needed with Qt 5
-        return {};
+        return createIndex(row, column, parentFolder->subFolders.at(row).get());
     }
 
     QModelIndex parent(const QModelIndex &index) const override
@@ -184,13 +1008,9 @@ public:
     {
         if (!folder || folder == m_emailRootFolder)
             return {};
-        auto parentFolder = folder->parentFolder ? folder->parentFolder : m_emailRootFolder;
-        const EmailFolders &folderList = parentFolder->subFolders;
-        const auto matchesFolderAddress = [&](const EmailFolder &candidate) { return &candidate == folder; };
-        const auto it = std::find_if(folderList.begin(), folderList.end(), matchesFolderAddress);
-        Q_ASSERT(it != folderList.end());
-        const int row = std::distance(folderList.begin(), it);
-        return createIndex(row, 0, folder);
+        // No need to search for the folder among its siblings, we know its row
+        Q_ASSERT((folder->parentFolder ? folder->parentFolder : m_emailRootFolder)->subFolders.at(folder->row).get() == folder);
+        return createIndex(folder->row, 0, folder);
     }
 
     EmailFolder *folderForIndex(const QModelIndex &index) const
@@ -200,6 +1020,81 @@ public:
         return m_emailRootFolder;
     }
 
+    EmailFolder *folderForId(int id) const { return m_foldersById.value(id); }
+
+    // Appends a new folder to parentFolder.
+    // This is O(1): thanks to the stable folder addresses, no other folder or index is affected.
+    EmailFolder *createFolder(EmailFolder *parentFolder, const QString &folderName)
+    {
+        const int row = int(parentFolder->subFolders.size());
+        beginInsertRows(indexForFolder(parentFolder), row, row);
+        EmailFolder *folder = appendFolder(*parentFolder, folderName);
+        registerFolders(folder);
+        endInsertRows();
+        emit folderCreated(folder);
+        return folder;
+    }
+
+    // Deletes a folder, with all its subfolders and emails
+    void deleteFolder(EmailFolder *folder)
+    {
+        Q_ASSERT(folder != m_emailRootFolder);
+        emit folderAboutToBeDeleted(folder);
+        EmailFolder *parentFolder = folder->parentFolder;
+        const int row = folder->row;
+        const int removedEmails = folder->totalEmails;
+        beginRemoveRows(indexForFolder(parentFolder), row, row);
+        unregisterFolders(folder);
+        auto &siblings = parentFolder->subFolders;
+        siblings.erase(siblings.begin() + row);
+        updateRows(siblings, row); // only the rows of the following siblings change
+        endRemoveRows();
+        addToTotals(parentFolder, -removedEmails);
+    }
+
+    // Appends the emails which aren't in the folder yet. A folder can already have some of the dropped emails,
+    // e.g. copied there before, or dragged from the search results of several folders containing the same email.
+    // This is O(folder size + dropped emails), without building a set of all the emails of the folder.
+    // Returns the IDs of the emails actually appended.
+    QVector<int> appendEmails(EmailFolder *folder, const QVector<int> &emailIds)
+    {
+        QSet<int> newEmailIds(emailIds.cbegin(), emailIds.cend());
+        for (int emailId : std::as_const(folder->emails)) {
+            newEmailIds.remove(emailId);
+            if (newEmailIds.isEmpty())
+                return {};
+        }
+        QVector<int> appendedEmailIds;
+        appendedEmailIds.reserve(newEmailIds.size());
+        for (int emailId : emailIds) {
+            if (newEmailIds.remove(emailId)) // keeps the order of the drop, and each email once
+                appendedEmailIds.append(emailId);
+        }
+        if (appendedEmailIds.isEmpty())
+            return {};
+        folder->emails += appendedEmailIds;
+        emailCountChanged(folder, appendedEmailIds.size());
+        emit emailsAppended(folder, appendedEmailIds.size());
+        return appendedEmailIds;
+    }
+
+    // For removing emails without going through EmailsModel (e.g. because it's showing another folder)
+    void removeEmails(EmailFolder *folder, int row, int count)
+    {
+        emit emailsAboutToBeRemoved(folder, row, count);
+        folder->emails.remove(row, count);
+        emit emailsRemoved(folder, row, count);
+        emailCountChanged(folder, -count);
+    }
+
+    // To be called after emails were added to `folder`, or removed from it (with a negative delta)
+    void emailCountChanged(EmailFolder *folder, int delta)
+    {
+        const QModelIndex countIndex = createIndex(folder->row, NumEmails, folder);
+        emit dataChanged(countIndex, countIndex, {Qt::DisplayRole});
+        addToTotals(folder, delta);
+    }
+
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
     {
         CHECK_data(index);
@@ -212,6 +1107,8 @@ public:
                 return folder->folderName;
             case NumEmails:
                 return folder->emails.size();
+            case TotalEmails:
+                return folder->totalEmails;
             default:
                 break;
         }
@@ -222,10 +1119,10 @@ public:
     {
         CHECK_flags(index);
         if (!index.isValid())
-            return {}; // do not allow dropping between items
+            return Qt::ItemIsDropEnabled; // folders can be moved to the toplevel (canDropMimeData rejects emails there)
         if (index.column() > 0)
             return Qt::ItemIsEnabled | Qt::ItemIsSelectable; // don't drop on other columns
-        return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDropEnabled;
+        return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDragEnabled | Qt::ItemIsDropEnabled;
     }
 
     QVariant headerData(int section, Qt::Orientation orientation, int role) const override
@@ -237,6 +1134,8 @@ public:
                     return "Folder Name";
                 case NumEmails:
                     return "Count";
+                case TotalEmails:
+                    return "Total";
                 default:
                     break;
             }
@@ -247,13 +1146,73 @@ public:
     // the default is "copy only", change it
     Qt::DropActions supportedDropActions() const override { return Qt::MoveAction | Qt::CopyAction; }
 
-    QStringList mimeTypes() const override { return {QString::fromLatin1(s_emailsMimeType)}; }
+    // Folders can only be moved, not copied
+    Qt::DropActions supportedDragActions() const override { return Qt::MoveAction; }
 
-    bool dropMimeData(const QMimeData *mimeData, Qt::DropAction action, int row, int column, const QModelIndex &parent) override
+    QStringList mimeTypes() const override
     {
-        // only drop onto items (just to be safe, given that dropping between items is forbidden by our flags() implementation)
-        if (!parent.isValid())
-            return false;
+        return {QString::fromLatin1(s_emailsMimeType), QString::fromLatin1(s_foldersMimeType), QString::fromLatin1(s_emailLocationsMimeType)};
+    }
+
+    // Dragging folders, to move them elsewhere in the hierarchy.
+    // The folders are identified by ID, there is no need to serialize their contents.
+    QMimeData *mimeData(const QModelIndexList &indexes) const override
+    {
+        QVector<EmailFolder *> draggedFolders;
+        for (const QModelIndex &index : indexes) {
+            // Note that with QTreeView, this is called for every column => deduplicate
+            EmailFolder *folder = folderForIndex(index);
+            if (!draggedFolders.contains(folder))
+                draggedFolders.append(folder);
+        }
+
+        QList<int> folderIds;
+        for (EmailFolder *folder : std::as_const(draggedFolders)) {
+            // No need to move a folder whose ancestor is being moved too, it will come along
+            const bool ancestorDragged = std::any_of(draggedFolders.cbegin(), draggedFolders.cend(), [folder](EmailFolder *other) {
+                return other != folder && isSameOrDescendant(folder, other);
+            });
+            if (!ancestorDragged)
+                folderIds.append(folder->id);
+        }
+
+        QByteArray encodedData;
+        QDataStream stream(&encodedData, QIODevice::WriteOnly);
+        stream << folderIds;
+
+        QMimeData *mimeData = new QMimeData;
+        mimeData->setData(s_foldersMimeType, encodedData);
+        return mimeData;
+    }
+
+    bool canDropMimeData(const QMimeData *mimeData, Qt::DropAction action, int row, int column, const QModelIndex &parent) const override
+    {
+        if (mimeData->hasFormat(s_foldersMimeType)) {
+            if (action != Qt::MoveAction)
+                return false;
+            // A folder can't be moved into itself or into one of its subfolders
+            const EmailFolder *destFolder = folderForIndex(parent);
+            const QList<int> folderIds = decodeFolderIds(mimeData);
+            return std::none_of(folderIds.cbegin(), folderIds.cend(), [&](int id) {
+                const EmailFolder *folder = folderForId(id);
+                return !folder || isSameOrDescendant(destFolder, folder);
+            });
+        }
+        // Emails can only be dropped onto folders
+        return (mimeData->hasFormat(s_emailsMimeType) || mimeData->hasFormat(s_emailLocationsMimeType)) && parent.isValid()
+            && QAbstractItemModel::canDropMimeData(mimeData, action, row, column, parent);
+    }
+
+    bool dropMimeData(const QMimeData *mimeData, Qt::DropAction action, int row, int column, const QModelIndex &parent) override
+    {
+        if (mimeData->hasFormat(s_foldersMimeType))
+            return dropFolders(mimeData, action, row, parent);
+
+        // only drop emails onto items (just to be safe, given that canDropMimeData rejects the other cases)
+        if (!parent.isValid())
+            return false;
+        if (mimeData->hasFormat(s_emailLocationsMimeType))
+            return dropEmailLocations(mimeData, action, folderForIndex(parent));
 
         EmailFolder *destFolder = folderForIndex(parent);
 
@@ -262,98 +1221,1342 @@ public:
         QDataStream stream(encodedData);
         if (stream.atEnd())
             return false;
-        QString sourceFolder;
-        stream >> sourceFolder;
+        int sourceFolderId;
+        stream >> sourceFolderId;
         // Dropping onto the same folder?
-        if (sourceFolder == destFolder->folderName)
+        // (comparing IDs rather than names: different folders can have the same name)
+        EmailFolder *sourceFolder = folderForId(sourceFolderId);
+        if (sourceFolder == destFolder)
             return false;
 
+        QVector<int> emailIds;
         while (!stream.atEnd()) {
-            QString email;
-            stream >> email;
-            destFolder->emails.append(email);
+            int emailId;
+            stream >> emailId;
+            emailIds.append(emailId);
         }
-        emit dataChanged(parent, parent);
+        const QVector<int> appendedEmailIds = appendEmails(destFolder, emailIds);
+        if (sourceFolder)
+            emit emailsTransferred(sourceFolder, destFolder, emailIds, action, appendedEmailIds);
 
         return true; // let the view handle deletion on the source side by calling removeRows there
     }
 
+    // Moves folders to another parent (or within the same parent).
+    // The folders are relinked, with all their subfolders and emails: this is O(1) in the size of
+    // the moved subtrees. Only the cached rows of the siblings after the source and destination
+    // positions need to be updated.
+    bool moveRows(const QModelIndex &sourceParent, int sourceRow, int count, const QModelIndex &destinationParent, int destinationChild) override
+    {
+        CHECK_moveRows(sourceParent, sourceRow, count, destinationParent, destinationChild);
+        EmailFolder *sourceFolder = folderForIndex(sourceParent);
+        EmailFolder *destFolder = folderForIndex(destinationParent);
+        auto &sourceList = sourceFolder->subFolders;
+        auto &destList = destFolder->subFolders;
+        for (int i = 0; i < count; ++i) {
+            if (isSameOrDescendant(destFolder, sourceList.at(sourceRow + i).get()))
+                return false; // can't move a folder into itself
+        }
+
+        if (!beginMoveRows(sourceParent, sourceRow, sourceRow + count - 1, destinationParent, destinationChild))
+            return false; // invalid move, e.g. no-op (move row 2 to row 2, or move row 2 to row 3)
+
+        int movedEmails = 0;
+        for (int i = 0; i < count; ++i)
+            movedEmails += sourceList.at(sourceRow + i)->totalEmails;
+
+        const auto sourceBegin = sourceList.begin() + sourceRow;
+        std::vector<std::unique_ptr<EmailFolder>> movedFolders(std::make_move_iterator(sourceBegin),
+                                                                std::make_move_iterator(sourceBegin + count));
+        sourceList.erase(sourceBegin, sourceBegin + count);
+        if (sourceFolder == destFolder && destinationChild > sourceRow)
+            destinationChild -= count; // adjust for the removal above
+        for (const auto &folder : movedFolders)
+            folder->parentFolder = destFolder;
+        destList.insert(destList.begin() + destinationChild, std::make_move_iterator(movedFolders.begin()),
+                        std::make_move_iterator(movedFolders.end()));
+
+        updateRows(sourceList, sourceRow);
+        updateRows(destList, sourceFolder == destFolder ? std::min(sourceRow, destinationChild) : destinationChild);
+
+        endMoveRows();
+
+        // The moved folders keep their own totals, only the old and new ancestors change,
+        // up to their common ancestor: its total, and those above it, stay the same
+        if (sourceFolder != destFolder) {
+            EmailFolder *commonAncestor = destFolder;
+            while (!isSameOrDescendant(sourceFolder, commonAncestor))
+                commonAncestor = commonAncestor->parentFolder;
+            addToTotals(sourceFolder, -movedEmails, commonAncestor);
+            addToTotals(destFolder, movedEmails, commonAncestor);
+        }
+        for (int row = destinationChild; row < destinationChild + count; ++row)
+            emit folderMoved(destList.at(row).get());
+        return true;
+    }
+
+signals:
+    // Emitted after createFolder(), for storage backends (not for the folders loaded by insertLoadedFolders())
+    void folderCreated(EmailFolder *folder);
+    // Emitted before `folder` and its subfolders are deleted
+    void folderAboutToBeDeleted(EmailFolder *folder);
+    // Emitted after `folder` was moved, with its subfolders, to folder->row in folder->parentFolder
+    void folderMoved(EmailFolder *folder);
+    // Emitted when a view wants to see the subfolders of a folder which are still loading
+    void subFoldersRequested(EmailFolder *folder);
+    // Emitted when emails are dropped from one folder to another, for storage backends, once they were
+    // appended to destFolder. When moving, removing them from sourceFolder comes right after: emailsRemoved,
+    // from this model or from EmailsModel (whose view, the drag source, removes them after the drop).
+    // `appendedEmailIds` are those of `emailIds` which weren't in destFolder already (see appendEmails()).
+    void emailsTransferred(EmailFolder *sourceFolder, EmailFolder *destFolder, const QVector<int> &emailIds, Qt::DropAction action,
+                           const QVector<int> &appendedEmailIds);
+    // Emitted after emails were dropped at the end of folder->emails
+    void emailsAppended(EmailFolder *folder, int count);
+    // Emitted around removeEmails()
+    void emailsAboutToBeRemoved(EmailFolder *folder, int row, int count);
+    void emailsRemoved(EmailFolder *folder, int row, int count);
+
 private:
+    // Emails dragged from the search results, possibly from several folders.
+    // When moving, the drag source can't remove them (they're not all in the folder it shows, if any),
+    // so we remove them from their folders here, and return false so that the view doesn't try to.
+    bool dropEmailLocations(const QMimeData *mimeData, Qt::DropAction action, EmailFolder *destFolder)
+    {
+        const QByteArray encodedData = mimeData->data(s_emailLocationsMimeType);
+        QDataStream stream(encodedData);
+        QVector<int> emailIds;
+        QHash<EmailFolder *, QVector<int>> emailIdsBySourceFolder;
+        while (!stream.atEnd()) {
+            int folderId;
+            int emailId;
+            stream >> folderId >> emailId;
+            EmailFolder *sourceFolder = folderForId(folderId);
+            if (!sourceFolder || sourceFolder == destFolder)
+                continue; // deleted since the search, or already there
+            emailIds.append(emailId);
+            emailIdsBySourceFolder[sourceFolder].append(emailId);
+        }
+
+        const QVector<int> appendedEmailIds = appendEmails(destFolder, emailIds);
+        // An email found in several source folders was appended from the first one only
+        QSet<int> appendedEmailIdSet(appendedEmailIds.cbegin(), appendedEmailIds.cend());
+        for (auto it = emailIdsBySourceFolder.cbegin(); it != emailIdsBySourceFolder.cend(); ++it) {
+            EmailFolder *sourceFolder = it.key();
+            QVector<int> appendedFromSource;
+            for (int emailId : it.value()) {
+                if (appendedEmailIdSet.remove(emailId))
+                    appendedFromSource.append(emailId);
+            }
+            emit emailsTransferred(sourceFolder, destFolder, it.value(), action, appendedFromSource);
+            if (action != Qt::MoveAction)
+                continue;
+            // One pass over each source folder, removing runs of consecutive rows at once, from the end
+            const QSet<int> movedEmailIds(it.value().cbegin(), it.value().cend());
+            for (int row = sourceFolder->emails.size() - 1; row >= 0;) {
+                if (!movedEmailIds.contains(sourceFolder->emails.at(row))) {
+                    --row;
+                    continue;
+                }
+                int firstRow = row;
+                while (firstRow > 0 && movedEmailIds.contains(sourceFolder->emails.at(firstRow - 1)))
+                    --firstRow;
+                removeEmails(sourceFolder, firstRow, row - firstRow + 1);
+                row = firstRow - 1;
+            }
+        }
+        return action != Qt::MoveAction;
+    }
+
+    static QList<int> decodeFolderIds(const QMimeData *mimeData)
+    {
+        QDataStream stream(mimeData->data(s_foldersMimeType));
+        QList<int> folderIds;
+        stream >> folderIds;
+        return folderIds;
+    }
+
+    bool dropFolders(const QMimeData *mimeData, Qt::DropAction action, int row, const QModelIndex &parent)
+    {
+        if (action != Qt::MoveAction)
+            return false;
+        EmailFolder *destFolder = folderForIndex(parent);
+        const QList<int> folderIds = decodeFolderIds(mimeData);
+        for (int id : folderIds) {
+            EmailFolder *folder = folderForId(id);
+            if (!folder || isSameOrDescendant(destFolder, folder))
+                continue;
+            // Dropping onto a folder (row == -1) means appending to its subfolders
+            const int destRow = row == -1 ? int(destFolder->subFolders.size()) : row;
+            // Don't use `parent`, a previous move might have invalidated it
+            moveRows(indexForFolder(folder->parentFolder), folder->row, 1, indexForFolder(destFolder), destRow);
+            if (row != -1)
+                row = folder->row + 1; // keep the order of the dropped folders
+        }
+        return false; // we moved the folders ourselves, the view must not remove anything
+    }
+
+    static int computeTotals(EmailFolder *folder) // recursive helper
+    {
+        folder->totalEmails = folder->emails.size();
+        for (const auto &childFolder : folder->subFolders)
+            folder->totalEmails += computeTotals(childFolder.get());
+        return folder->totalEmails;
+    }
+
+    // Updates the totals of `folder` and its ancestors: O(depth), rather than recounting
+    // the subtree on every paint. Only the "Total" column of these folders is notified as changed.
+    // Up to the root folder, or up to `stopAt` (excluded)
+    void addToTotals(EmailFolder *folder, int delta, const EmailFolder *stopAt = nullptr)
+    {
+        for (; folder != stopAt; folder = folder->parentFolder) {
+            folder->totalEmails += delta;
+            if (folder != m_emailRootFolder) {
+                const QModelIndex totalIndex = createIndex(folder->row, TotalEmails, folder);
+                emit dataChanged(totalIndex, totalIndex, {Qt::DisplayRole});
+            }
+        }
+    }
+
+    void registerFolders(EmailFolder *folder) // recursive helper
+    {
+        // Folders restored by EmailJournal come with their ID, keep it
+        if (folder->id < 0)
+            folder->id = m_nextFolderId++;
+        else
+            m_nextFolderId = std::max(m_nextFolderId, folder->id + 1);
+        m_foldersById.insert(folder->id, folder);
+        for (const auto &childFolder : folder->subFolders)
+            registerFolders(childFolder.get());
+    }
+
+    void unregisterFolders(EmailFolder *folder) // recursive helper
+    {
+        m_foldersById.remove(folder->id);
+        for (const auto &childFolder : folder->subFolders)
+            unregisterFolders(childFolder.get());
+    }
+
     EmailFolder *m_emailRootFolder = nullptr;
+    QHash<int, EmailFolder *> m_foldersById;
+    int m_nextFolderId = 0;
 };
 
-class TopLevel : public QWidget
+// Results of EmailIndex::search(), one row per (folder, email) pair.
+// Can be dragged onto folders, to move or copy emails there from all the folders they were found in.
+class SearchResultsModel : public QAbstractTableModel
+{
+public:
+    SearchResultsModel(const EmailStore *emailStore, const FoldersModel *foldersModel, QObject *parent = nullptr)
+        : QAbstractTableModel(parent)
+        , m_emailStore(emailStore)
+        , m_foldersModel(foldersModel)
+    {
+    }
+
+    enum Columns { Subject, Sender, Folder, COLUMNCOUNT };
+
+    void setResults(const QVector<EmailIndex::Location> &results)
+    {
+        beginResetModel();
+        m_results = results;
+        endResetModel();
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        CHECK_rowCount(parent);
+        if (parent.isValid())
+            return 0;
+        return m_results.size();
+    }
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        CHECK_columnCount(parent);
+        if (parent.isValid())
+            return 0;
+        return COLUMNCOUNT;
+    }
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
+    {
+        CHECK_data(index);
+        if (!index.isValid() || role != Qt::DisplayRole)
+            return QVariant();
+
+        const EmailIndex::Location &result = m_results.at(index.row());
+        switch (index.column()) {
+        case Subject:
+            return m_emailStore->displaySubject(result.emailId);
+        case Sender:
+            return m_emailStore->sender(result.emailId).toString();
+        case Folder:
+            if (const EmailFolder *folder = m_foldersModel->folderForId(result.folderId))
+                return folder->folderName;
+            break;
+        }
+        return QVariant();
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const override
+    {
+        CHECK_headerData(section, orientation);
+        if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+            switch (section) {
+            case Subject:
+                return "Subject";
+            case Sender:
+                return "From";
+            case Folder:
+                return "Folder";
+            }
+        }
+        return {};
+    }
+
+    Qt::ItemFlags flags(const QModelIndex &index) const override
+    {
+        CHECK_flags(index);
+        if (!index.isValid())
+            return {};
+        return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDragEnabled;
+    }
+
+    Qt::DropActions supportedDragActions() const override { return Qt::MoveAction | Qt::CopyAction; }
+
+    QStringList mimeTypes() const override { return {QString::fromLatin1(s_emailLocationsMimeType)}; }
+
+    QMimeData *mimeData(const QModelIndexList &indexes) const override
+    {
+        QSet<int> seenRows;
+        QByteArray encodedData;
+        QDataStream stream(&encodedData, QIODevice::WriteOnly);
+        for (const QModelIndex &index : indexes) {
+            const int row = index.row();
+            // Note that with QTreeView, this is called for every column => deduplicate
+            if (!seenRows.contains(row)) {
+                seenRows.insert(row);
+                stream << m_results.at(row).folderId << m_results.at(row).emailId;
+            }
+        }
+
+        QMimeData *mimeData = new QMimeData;
+        mimeData->setData(s_emailLocationsMimeType, encodedData);
+        return mimeData;
+    }
+
+private:
+    const EmailStore *m_emailStore;
+    const FoldersModel *m_foldersModel;
+    QVector<EmailIndex::Location> m_results;
+};
+
+// Loads the folders in a worker thread, so that the GUI stays responsive meanwhile.
+// This goes one level at a time: first the top-level folders (published in one go, see
+// FoldersModel::setEmailFolders), then the subfolders of each folder, which are inserted as they come.
+// When the user expands a folder whose subfolders are still loading, they're loaded next.
+class EmailFolderLoader : public QObject
 {
+    Q_OBJECT
+
 public:
-    explicit TopLevel();
+    struct Folder
+    {
+        QString name; // can't contain '/', see ListSubFolders
+        QVector<int> emails; // IDs in the Batch's email store
+        bool hasSubFolders = false;
+    };
+
+    // The result of one call to ListSubFolders
+    struct Batch
+    {
+        QString path;
+        QVector<Folder> folders;
+        EmailStore emailStore;
+    };
+
+    // Called in the worker thread, returns the subfolders of the folder at `path`, and adds their emails
+    // to `emailStore`. The path is the names of the ancestors and of the folder, separated with '/'.
+    // It's empty for the top-level folders.
+    using ListSubFolders = std::function<QVector<Folder>(const QString &path, EmailStore &emailStore)>;
+
+    using QObject::QObject;
+
+    ~EmailFolderLoader() override
+    {
+        m_canceled = true;
+        m_future.waitForFinished();
+    }
+
+    void start(const ListSubFolders &listSubFolders)
+    {
+        m_queue.push_back(QString());
+        m_future = QtConcurrent::run([this, listSubFolders] { run(listSubFolders); });
+    }
+
+    // Loads the subfolders at `path` before the other pending ones
+    void prioritize(const QString &path)
+    {
+        QMutexLocker locker(&m_mutex);
+        const auto it = std::find(m_queue.begin(), m_queue.end(), path);
+        if (it != m_queue.end())
+            std::rotate(m_queue.begin(), it, it + 1);
+    }
+
+signals:
+    // Emitted in the thread of this object, not in the worker thread
+    void subFoldersLoaded(const EmailFolderLoader::Batch &batch);
+    void finished();
 
 private:
-    // Application data
-    // clang-format off
-    EmailFolder m_emails = { "HIDDEN ROOT",
-        {
-            { "Inbox",
-                {{ "Customers", {}, {"Old customer"} }},
-                {"Call your mother", "Customer request", "Urgent", "Spam 1"} },
-            { "Archive", {
-                { "2023", {}, {"Old 2023 email"} },
-                { "2024", {}, {"Old email 1", "Old email 2", "Old email 3", "Old email 4"}}
-                }, {}},
-            { "Spam", {}, {"Old spam"} },
-            { "To do", {}, {} },
-            { "Will never be done", {}, {"Clean the garage"} }
+    void run(const ListSubFolders &listSubFolders)
+    {
+        while (!m_canceled) {
+            auto batch = std::make_shared<Batch>();
+            {
+                QMutexLocker locker(&m_mutex);
+                if (m_queue.empty())
+                    break;
+                batch->path = m_queue.front();
+                m_queue.pop_front();
+            }
+            batch->folders = listSubFolders(batch->path, batch->emailStore);
+            {
+                QMutexLocker locker(&m_mutex);
+                for (const Folder &folder : std::as_const(batch->folders)) {
+                    if (folder.hasSubFolders)
+                        m_queue.push_back(batch->path.isEmpty() ? folder.name : batch->path + '/' + folder.name);
+                }
+            }
+            // Hand the batch over to the GUI thread. Nothing is shared: the worker doesn't touch it anymore.
+            QMetaObject::invokeMethod(this, [this, batch] { emit subFoldersLoaded(*batch); }, Qt::QueuedConnection);
+        }
+        QMetaObject::invokeMethod(this, [this] { emit finished(); }, Qt::QueuedConnection);
+    }
+
+    QFuture<void> m_future;
+    std::atomic<bool> m_canceled{false};
+    QMutex m_mutex; // protects m_queue
+    std::deque<QString> m_queue; // paths of the folders whose subfolders still have to be loaded
+};
+
+// Emails stored in a maildir tree (https://cr.yp.to/proto/maildir.html): each email is a file in the
+// cur/ or new/ subdirectory of its folder's directory. Subfolders are the other subdirectories
+// (the root directory itself is not a folder).
+// Loading only parses the few headers needed for the columns, and doesn't even decode the subject
+// (see EmailStore::RawSubject). Moving emails to another folder renames their files.
+class MaildirBackend
+{
+public:
+    explicit MaildirBackend(const QString &rootPath)
+        : m_rootPath(rootPath)
+    {
+    }
+
+    // For EmailFolderLoader. Only uses the root path, so it's safe to call from the worker thread.
+    EmailFolderLoader::ListSubFolders subFolderLister() const
+    {
+        const QString rootPath = m_rootPath;
+        return [rootPath](const QString &path, EmailStore &emailStore) {
+            QVector<EmailFolderLoader::Folder> folders;
+            const QDir dir(rootPath + '/' + path);
+            const QStringList folderNames = subFolderNames(dir);
+            for (const QString &folderName : folderNames) {
+                const QDir folderDir(dir.filePath(folderName));
+                EmailFolderLoader::Folder folder;
+                folder.name = folderName;
+                for (const QString subdir : {QStringLiteral("new"), QStringLiteral("cur")}) {
+                    const QFileInfoList files = QDir(folderDir.filePath(subdir)).entryInfoList(QDir::Files, QDir::NoSort);
+                    for (const QFileInfo &fileInfo : files) {
+                        const int emailId = readEmail(fileInfo, subdir, emailStore);
+                        if (emailId >= 0)
+                            folder.emails.append(emailId);
+                    }
+                }
+                folder.hasSubFolders = !subFolderNames(folderDir).isEmpty();
+                folders.append(folder);
+            }
+            return folders;
+        };
+    }
+
+    // To be called for each loaded folder, with the path given to the lister
+    void setFolderPath(int folderId, const QString &path) { m_folderPaths.insert(folderId, path); }
+
+    // Does on disk what FoldersModel did in memory, see FoldersModel::emailsTransferred.
+    // The emails which were in destFolder already are not copied again: when moving, their file in sourceFolder
+    // is just deleted. That's the emails FoldersModel didn't append, e.g. copied there before, and the files
+    // which exist in both directories, e.g. copied by another email client (with a different email ID each).
+    void transferEmails(const EmailFolder *sourceFolder, const EmailFolder *destFolder, const QVector<int> &emailIds, Qt::DropAction action,
+                        const QVector<int> &appendedEmailIds, const EmailStore &emailStore)
+    {
+        const QString sourceDir = m_rootPath + '/' + folderPath(sourceFolder);
+        const QString destDir = m_rootPath + '/' + folderPath(destFolder);
+        const QSet<int> appendedEmailIdSet(appendedEmailIds.cbegin(), appendedEmailIds.cend());
+        const bool moving = action == Qt::MoveAction;
+        for (int emailId : emailIds) {
+            const QString location = emailStore.location(emailId).toString();
+            if (location.isEmpty())
+                continue; // not from the maildir
+            const QString sourceFile = sourceDir + '/' + location;
+            const QString destFile = destDir + '/' + location;
+            if (!appendedEmailIdSet.contains(emailId) || QFile::exists(destFile)) {
+                if (moving && !QFile::remove(sourceFile))
+                    qWarning() << "Could not delete" << sourceFile;
+                continue;
+            }
+            if (!(moving ? QFile::rename(sourceFile, destFile) : QFile::copy(sourceFile, destFile)))
+                qWarning() << "Could not" << (moving ? "move" : "copy") << sourceFile << "to" << destFile;
         }
+    }
+
+private:
+    static QStringList subFolderNames(const QDir &dir)
+    {
+        QStringList names = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+        names.removeOne(QStringLiteral("cur"));
+        names.removeOne(QStringLiteral("new"));
+        names.removeOne(QStringLiteral("tmp"));
+        return names;
+    }
+
+    // Returns the ID of the new email in `emailStore`, or -1 if the file can't be read
+    static int readEmail(const QFileInfo &fileInfo, const QString &subdir, EmailStore &emailStore)
+    {
+        QFile file(fileInfo.filePath());
+        if (!file.open(QIODevice::ReadOnly))
+            return -1;
+        QByteArray subject;
+        QByteArray from;
+        QByteArray date;
+        QByteArray contentType;
+        QByteArray *currentHeader = nullptr;
+        while (!file.atEnd()) {
+            const QByteArray line = file.readLine();
+            const QByteArray trimmedLine = line.trimmed();
+            if (trimmedLine.isEmpty())
+                break; // end of the headers, the body isn't read at all
+            if (line.startsWith(' ') || line.startsWith('\t')) { // continuation of a folded header
+                if (currentHeader)
+                    *currentHeader += ' ' + trimmedLine;
+                continue;
+            }
+            const int colon = line.indexOf(':');
+            const QByteArray name = colon < 0 ? QByteArray() : line.left(colon).toLower();
+            currentHeader = name == "subject" ? &subject : name == "from" ? &from : name == "date" ? &date : name == "content-type" ? &contentType : nullptr;
+            if (currentHeader)
+                *currentHeader = line.mid(colon + 1).trimmed();
+        }
+
+        // Flags are in the file name, after ":2,"; "S" means seen, "F" flagged
+        const QString fileName = fileInfo.fileName();
+        const int infoPos = fileName.indexOf(QLatin1String(":2,"));
+        const QString info = infoPos < 0 ? QString() : fileName.mid(infoPos + 3);
+        quint64 flags = EmailStore::RawSubject;
+        if (subdir == QLatin1String("new") || !info.contains('S'))
+            flags |= EmailStore::Unread;
+        if (info.contains('F'))
+            flags |= EmailStore::Flagged;
+        if (contentType.toLower().startsWith("multipart/mixed"))
+            flags |= EmailStore::HasAttachment;
+
+        QDateTime dateTime = QDateTime::fromString(QString::fromLatin1(date), Qt::RFC2822Date);
+        if (!dateTime.isValid())
+            dateTime = fileInfo.lastModified();
+        return emailStore.addEmail(QString::fromLatin1(subject), decodeHeader(QString::fromLatin1(from)), dateTime.toMSecsSinceEpoch(),
+                                   fileInfo.size(), flags, subdir + '/' + fileName);
+    }
+
+    // Relative to the root directory. Folders created by the user get a new directory.
+    QString folderPath(const EmailFolder *folder)
+    {
+        const auto it = m_folderPaths.constFind(folder->id);
+        if (it != m_folderPaths.cend())
+            return it.value();
+        const EmailFolder *parentFolder = folder->parentFolder;
+        const bool isTopLevel = !parentFolder->parentFolder;
+        const QString path = isTopLevel ? folder->folderName : folderPath(parentFolder) + '/' + folder->folderName;
+        for (const QString subdir : {QStringLiteral("cur"), QStringLiteral("new"), QStringLiteral("tmp")})
+            QDir(m_rootPath).mkpath(path + '/' + subdir);
+        m_folderPaths.insert(folder->id, path);
+        return path;
+    }
+
+    const QString m_rootPath;
+    QHash<int, QString> m_folderPaths; // by folder ID
+};
+
+// Persists the moves and copies of emails between folders, without rewriting everything after each drop:
+// each drop appends a small record (action, source folder ID, destination folder ID, email IDs) to a journal.
+// Records are written by a worker thread, in batches ("group commit"): all the records made while
+// the previous batch was being written and synced to disk are written with a single write() and fsync().
+// Now and then, the journal is compacted: the complete state is written to a snapshot file, in another
+// worker thread, and the journal files it covers are deleted. On startup, restore() loads the snapshot,
+// and replays the newer journal files on top of it.
+// Creating, deleting and moving folders is journaled the same way, with the IDs of the folders: the emails
+// dropped onto a new folder must find it on replay.
+class EmailJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EmailJournal(const QString &directory, QObject *parent = nullptr)
+        : QObject(parent)
+        , m_directory(directory)
+    {
+        QDir().mkpath(m_directory);
+        m_writerPool.setMaxThreadCount(1); // journal writes must happen in order
+        connect(&m_flushWatcher, &QFutureWatcher<void>::finished, this, &EmailJournal::flush);
+        connect(&m_compactionWatcher, &QFutureWatcher<QString>::finished, this, [this] {
+            const QString errorMessage = m_compactionWatcher.result();
+            if (!errorMessage.isEmpty()) {
+                emit error(errorMessage); // the previous snapshot and the journals since are still there
+                return;
+            }
+            m_recordsSinceSnapshot -= m_compactedRecords; // the ones recorded during the compaction aren't in the snapshot
+        });
+    }
+
+    ~EmailJournal() override
+    {
+        m_writerPool.waitForDone();
+        if (!m_pendingRecords.isEmpty()) // the writer thread is idle by now
+            writeRecords(m_pendingRecords, m_generation);
+        m_compactionWatcher.waitForFinished();
+    }
+
+    // Loads the last snapshot and replays the journals written since. Returns false if there's no snapshot.
+    bool restore(EmailStore &emailStore, EmailFolder &rootFolder)
+    {
+        const QList<int> generations = journalGenerations();
+        m_generation = generations.isEmpty() ? 0 : generations.last() + 1; // new records go to a new file
+        QFile snapshotFile(snapshotPath());
+        if (!snapshotFile.open(QIODevice::ReadOnly))
+            return false;
+        QDataStream stream(&snapshotFile);
+        quint32 magic;
+        qint32 version;
+        qint32 firstGeneration; // the first journal not included in the snapshot
+        stream >> magic >> version >> firstGeneration;
+        if (magic != s_snapshotMagic || version != 1) {
+            qWarning() << "Invalid journal snapshot" << snapshotPath();
+            return false;
+        }
+        qint32 emailCount;
+        stream >> emailCount;
+        for (int i = 0; i < emailCount; ++i) {
+            QString subject, sender, location;
+            qint64 date, size;
+            quint64 flags;
+            stream >> subject >> sender >> date >> size >> flags >> location;
+            emailStore.addEmail(subject, sender, date, size, flags, location);
+        }
+        QHash<int, EmailFolder *> foldersById;
+        readFolders(stream, rootFolder, foldersById);
+        if (stream.status() != QDataStream::Ok) {
+            qWarning() << "Truncated journal snapshot" << snapshotPath();
+            return false;
+        }
+
+        for (int generation : generations) {
+            if (generation >= firstGeneration)
+                replay(journalPath(generation), foldersById);
+        }
+        return true;
+    }
+
+    // Records the changes made in `foldersModel`: emails dropped onto folders, and folders created, deleted or moved.
+    // Each record is written and synced to disk with the next batch.
+    void recordChanges(FoldersModel *foldersModel)
+    {
+        connect(foldersModel, &FoldersModel::emailsTransferred, this,
+                [this](EmailFolder *sourceFolder, EmailFolder *destFolder, const QVector<int> &emailIds, Qt::DropAction action) {
+                    record(action == Qt::MoveAction ? MoveRecord : CopyRecord, qint32(sourceFolder->id), qint32(destFolder->id), emailIds);
+                });
+        connect(foldersModel, &FoldersModel::folderCreated, this, [this](EmailFolder *folder) {
+            record(CreateFolderRecord, qint32(folder->parentFolder->id), qint32(folder->id), folder->folderName);
+        });
+        connect(foldersModel, &FoldersModel::folderAboutToBeDeleted, this,
+                [this](EmailFolder *folder) { record(DeleteFolderRecord, qint32(folder->id)); });
+        connect(foldersModel, &FoldersModel::folderMoved, this, [this](EmailFolder *folder) {
+            record(MoveFolderRecord, qint32(folder->id), qint32(folder->parentFolder->id), qint32(folder->row));
+        });
+    }
+
+    // False once everything recorded so far is on disk
+    bool hasUnwrittenRecords() const { return !m_pendingRecords.isEmpty() || m_flushWatcher.isRunning(); }
+
+    // The number of records which would be replayed on startup; compact() when it gets too big
+    int recordsSinceSnapshot() const { return m_recordsSinceSnapshot; }
+    bool isCompacting() const { return m_compactionWatcher.isRunning(); }
+
+    // Writes a snapshot of the current state in a worker thread, and deletes the journals it covers.
+    // The email store must not be modified until this is done (it's only appended to while loading).
+    void compact(const EmailStore &emailStore, const EmailFolder &rootFolder)
+    {
+        if (isCompacting())
+            return;
+        // The records not written yet are included in the snapshot, so they must go to the old file:
+        // replaying them on top of the snapshot would apply them twice
+        if (!m_pendingRecords.isEmpty()) {
+            const QByteArray records = m_pendingRecords;
+            m_pendingRecords.clear();
+            const int generation = m_generation;
+            m_writerPool.start([this, records, generation] { writeRecords(records, generation); });
+        }
+        // The journal written from now on won't be included in the snapshot: switch to a new file
+        const int firstGeneration = ++m_generation;
+        m_compactedRecords = m_recordsSinceSnapshot;
+        const QFuture<void> rotation = QtConcurrent::run(&m_writerPool, [this, firstGeneration] { openJournal(firstGeneration); });
+
+        // Copying the folders is cheap: the email lists are implicitly shared
+        auto rootCopy = std::make_shared<SnapshotFolder>(copyFolders(rootFolder));
+        const EmailStore *store = &emailStore;
+        const int emailCount = emailStore.count();
+        const QString directory = m_directory;
+        m_compactionWatcher.setFuture(QtConcurrent::run([=] {
+            QSaveFile file(directory + QLatin1String("/snapshot"));
+            if (!file.open(QIODevice::WriteOnly))
+                return writeError(file);
+            QDataStream stream(&file);
+            stream << s_snapshotMagic << qint32(1) << qint32(firstGeneration) << qint32(emailCount);
+            for (int id = 0; id < emailCount; ++id) {
+                stream << store->subject(id).toString() << store->sender(id).toString() << store->date(id) << store->size(id)
+                       << store->flags(id) << store->location(id).toString();
+            }
+            writeFolders(stream, *rootCopy);
+            if (!file.commit()) // atomically replaces the previous snapshot
+                return writeError(file);
+            rotation.waitForFinished(); // before deleting the journal files which are no longer needed
+            const QStringList journalFiles = QDir(directory).entryList({QStringLiteral("journal-*")}, QDir::Files);
+            for (const QString &fileName : journalFiles) {
+                if (generationFromFileName(fileName) < firstGeneration)
+                    QFile::remove(directory + '/' + fileName);
+            }
+            return QString();
+        }));
+    }
+
+signals:
+    // A journal or a snapshot couldn't be written: the changes made since the last snapshot might be lost
+    void error(const QString &message);
+
+private:
+    enum RecordType : quint8 { MoveRecord = 1, CopyRecord = 2, CreateFolderRecord = 3, DeleteFolderRecord = 4, MoveFolderRecord = 5 };
+    static constexpr quint32 s_snapshotMagic = 0x454d4c53; // "EMLS"
+
+    struct SnapshotFolder
+    {
+        QString name;
+        int id;
+        QVector<int> emails;
+        std::vector<SnapshotFolder> subFolders;
     };
-    // clang-format on
+
+    template<typename... Fields>
+    void record(RecordType type, const Fields &...fields)
+    {
+        QDataStream stream(&m_pendingRecords, QIODevice::WriteOnly | QIODevice::Append);
+        stream << quint8(type);
+        (stream << ... << fields);
+        ++m_recordsSinceSnapshot;
+        flush();
+    }
+
+    static QString writeError(const QFileDevice &file)
+    {
+        qWarning() << "Could not write" << file.fileName() << file.errorString();
+        return QStringLiteral("Could not write %1: %2").arg(file.fileName(), file.errorString());
+    }
+
+    // Group commit: only one batch is being written at any time, the next one is sent when it's done
+    void flush()
+    {
+        if (m_pendingRecords.isEmpty() || m_flushWatcher.isRunning())
+            return;
+        const QByteArray records = m_pendingRecords;
+        m_pendingRecords.clear();
+        const int generation = m_generation;
+        m_flushWatcher.setFuture(QtConcurrent::run(&m_writerPool, [this, records, generation] { writeRecords(records, generation); }));
+    }
+
+    // In the writer thread
+    void writeRecords(const QByteArray &records, int generation)
+    {
+        if (!m_journalFile.isOpen())
+            openJournal(generation);
+        if (m_journalFile.write(records) != records.size() || !syncToDisk(m_journalFile))
+            emit error(writeError(m_journalFile)); // queued to the GUI thread
+    }
+
+    // In the writer thread
+    void openJournal(int generation)
+    {
+        m_journalFile.close();
+        m_journalFile.setFileName(journalPath(generation));
+        if (!m_journalFile.open(QIODevice::WriteOnly | QIODevice::Append))
+            qWarning() << "Could not open" << m_journalFile.fileName() << m_journalFile.errorString();
+    }
+
+    static bool syncToDisk(QFile &file)
+    {
+        if (!file.flush())
+            return false;
+#ifdef Q_OS_WIN
+        return _commit(file.handle()) == 0;
+#else
+        return ::fsync(file.handle()) == 0;
+#endif
+    }
+
+    // Replaying a record twice (e.g. after a crash in the middle of a compaction) doesn't duplicate emails or folders
+    static void replay(const QString &fileName, QHash<int, EmailFolder *> &foldersById)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return;
+        QDataStream stream(&file);
+        while (!stream.atEnd()) {
+            quint8 type;
+            stream >> type;
+            switch (type) {
+            case MoveRecord:
+            case CopyRecord: {
+                qint32 sourceFolderId, destFolderId;
+                QVector<int> emailIds;
+                stream >> sourceFolderId >> destFolderId >> emailIds;
+                EmailFolder *sourceFolder = foldersById.value(sourceFolderId);
+                EmailFolder *destFolder = foldersById.value(destFolderId);
+                if (stream.status() == QDataStream::Ok && sourceFolder && destFolder) // or deleted later on
+                    replayTransfer(sourceFolder, destFolder, emailIds, type == MoveRecord);
+                break;
+            }
+            case CreateFolderRecord: {
+                qint32 parentFolderId, folderId;
+                QString folderName;
+                stream >> parentFolderId >> folderId >> folderName;
+                EmailFolder *parentFolder = foldersById.value(parentFolderId);
+                if (stream.status() == QDataStream::Ok && parentFolder && !foldersById.contains(folderId)) {
+                    EmailFolder *folder = appendFolder(*parentFolder, folderName);
+                    folder->id = folderId; // kept by FoldersModel::registerFolders()
+                    foldersById.insert(folderId, folder);
+                }
+                break;
+            }
+            case DeleteFolderRecord: {
+                qint32 folderId;
+                stream >> folderId;
+                EmailFolder *folder = foldersById.value(folderId);
+                if (stream.status() == QDataStream::Ok && folder && folder->parentFolder) {
+                    forgetFolders(*folder, foldersById);
+                    auto &siblings = folder->parentFolder->subFolders;
+                    const int row = folder->row;
+                    siblings.erase(siblings.begin() + row);
+                    updateRows(siblings, row);
+                }
+                break;
+            }
+            case MoveFolderRecord: {
+                qint32 folderId, parentFolderId, row;
+                stream >> folderId >> parentFolderId >> row;
+                EmailFolder *folder = foldersById.value(folderId);
+                EmailFolder *parentFolder = foldersById.value(parentFolderId);
+                if (stream.status() == QDataStream::Ok && folder && folder->parentFolder && parentFolder
+                    && !isSameOrDescendant(parentFolder, folder)) {
+                    auto &oldSiblings = folder->parentFolder->subFolders;
+                    const int oldRow = folder->row;
+                    std::unique_ptr<EmailFolder> movedFolder = std::move(oldSiblings.at(oldRow));
+                    oldSiblings.erase(oldSiblings.begin() + oldRow);
+                    updateRows(oldSiblings, oldRow);
+                    auto &newSiblings = parentFolder->subFolders;
+                    const int newRow = std::clamp(int(row), 0, int(newSiblings.size()));
+                    folder->parentFolder = parentFolder;
+                    newSiblings.insert(newSiblings.begin() + newRow, std::move(movedFolder));
+                    updateRows(newSiblings, newRow);
+                }
+                break;
+            }
+            default:
+                qWarning() << "Unknown record" << type << "in" << fileName;
+                return;
+            }
+            if (stream.status() != QDataStream::Ok)
+                break; // the last record was only partially written, e.g. because of a crash
+        }
+    }
+
+    static void replayTransfer(EmailFolder *sourceFolder, EmailFolder *destFolder, const QVector<int> &emailIds, bool move)
+    {
+        if (move) {
+            const QSet<int> movedEmailIds(emailIds.cbegin(), emailIds.cend());
+            auto &emails = sourceFolder->emails;
+            emails.erase(std::remove_if(emails.begin(), emails.end(), [&](int id) { return movedEmailIds.contains(id); }), emails.end());
+        }
+        const QSet<int> existingEmailIds(destFolder->emails.cbegin(), destFolder->emails.cend());
+        for (int id : emailIds) {
+            if (!existingEmailIds.contains(id))
+                destFolder->emails.append(id);
+        }
+    }
+
+    static void forgetFolders(const EmailFolder &folder, QHash<int, EmailFolder *> &foldersById)
+    {
+        foldersById.remove(folder.id);
+        for (const auto &subFolder : folder.subFolders)
+            forgetFolders(*subFolder, foldersById);
+    }
+
+    static SnapshotFolder copyFolders(const EmailFolder &folder)
+    {
+        SnapshotFolder copy{folder.folderName, folder.id, folder.emails, {}};
+        copy.subFolders.reserve(folder.subFolders.size());
+        for (const auto &subFolder : folder.subFolders)
+            copy.subFolders.push_back(copyFolders(*subFolder));
+        return copy;
+    }
+
+    static void writeFolders(QDataStream &stream, const SnapshotFolder &folder)
+    {
+        stream << folder.name << qint32(folder.id) << folder.emails << quint32(folder.subFolders.size());
+        for (const SnapshotFolder &subFolder : folder.subFolders)
+            writeFolders(stream, subFolder);
+    }
+
+    static void readFolders(QDataStream &stream, EmailFolder &folder, QHash<int, EmailFolder *> &foldersById)
+    {
+        qint32 id;
+        quint32 subFolderCount;
+        stream >> folder.folderName >> id >> folder.emails >> subFolderCount;
+        folder.id = id;
+        foldersById.insert(id, &folder);
+        for (quint32 i = 0; i < subFolderCount && stream.status() == QDataStream::Ok; ++i) {
+            EmailFolder *subFolder = appendFolder(folder, QString());
+            readFolders(stream, *subFolder, foldersById);
+        }
+    }
+
+    static int generationFromFileName(const QString &fileName) { return fileName.mid(int(qstrlen("journal-"))).toInt(); }
+
+    QList<int> journalGenerations() const
+    {
+        QList<int> generations;
+        const QStringList journalFiles = QDir(m_directory).entryList({QStringLiteral("journal-*")}, QDir::Files);
+        for (const QString &fileName : journalFiles)
+            generations.append(generationFromFileName(fileName));
+        std::sort(generations.begin(), generations.end());
+        return generations;
+    }
+
+    QString snapshotPath() const { return m_directory + QLatin1String("/snapshot"); }
+    QString journalPath(int generation) const { return m_directory + QLatin1String("/journal-") + QString::number(generation); }
+
+    const QString m_directory;
+    int m_generation = 0; // the number of the journal file being written
+    int m_recordsSinceSnapshot = 0;
+    int m_compactedRecords = 0; // m_recordsSinceSnapshot when the running compaction started
+    QByteArray m_pendingRecords; // not sent to the writer thread yet
+    QThreadPool m_writerPool;
+    QFile m_journalFile; // only used in the writer thread
+    QFutureWatcher<void> m_flushWatcher;
+    QFutureWatcher<QString> m_compactionWatcher; // with an error message if the snapshot couldn't be written
+};
+
+// The demo data. A real application would read the folders from disk, which can take a while:
+// this is simulated with a delay.
+static QVector<EmailFolderLoader::Folder> listDemoSubFolders(const QString &path, EmailStore &emailStore)
+{
+    QThread::msleep(300);
+
+    // Dates are in UTC
+    const auto email = [&emailStore](const QString &subject, const QString &sender, const char *date, qint64 size,
+                                     quint64 flags = EmailStore::NoFlags) {
+        const qint64 msecs = QDateTime::fromString(QString::fromLatin1(date), Qt::ISODate).toMSecsSinceEpoch();
+        return emailStore.addEmail(subject, sender, msecs, size, flags);
+    };
+    if (path.isEmpty()) {
+        return {{"Inbox",
+                 {email("Call your mother", "Dad", "2024-06-03T08:15:00Z", 2300, EmailStore::Unread),
+                  email("Customer request", "Customer", "2024-06-02T14:02:00Z", 48500, EmailStore::HasAttachment),
+                  email("Urgent", "Boss", "2024-06-03T09:40:00Z", 1800, EmailStore::Unread | EmailStore::Flagged),
+                  email("Spam 1", "Spammer", "2024-06-01T03:00:00Z", 12000)},
+                 true},
+                {"Archive", {}, true},
+                {"Spam", {email("Old spam", "Spammer", "2024-05-30T02:00:00Z", 15000)}},
+                {"To do", {}},
+                {"Will never be done", {email("Clean the garage", "Mom", "2021-09-01T12:00:00Z", 700, EmailStore::Flagged)}}};
+    }
+    if (path == "Inbox")
+        return {{"Customers", {email("Old customer", "Customer", "2022-11-20T10:00:00Z", 5400)}}};
+    if (path == "Archive") {
+        return {{"2023", {email("Old 2023 email", "Boss", "2023-03-14T16:20:00Z", 3100)}},
+                {"2024",
+                 {email("Old email 1", "Boss", "2024-01-08T09:00:00Z", 2100), email("Old email 2", "Dad", "2024-02-11T19:30:00Z", 950),
+                  email("Old email 3", "Customer", "2024-03-05T11:45:00Z", 250000, EmailStore::HasAttachment),
+                  email("Old email 4", "Boss", "2024-04-22T08:05:00Z", 1400, EmailStore::Flagged)}}};
+    }
+    return {};
+}
+
+// Generated folders and emails, for testing with more data (see --folders, --emails-per-folder, --depth and --fanout).
+// The folder tree is generated upfront, with a skewed fan-out and Zipf-distributed folder sizes (a few huge
+// folders, many small ones). The emails of each folder are only generated when it's loaded, from its path.
+static EmailFolderLoader::ListSubFolders syntheticSubFolderLister(int folderCount, int depth, int fanout, int emailsPerFolder, quint32 seed)
+{
+    struct SyntheticFolder
+    {
+        QString name;
+        int emailCount;
+        bool hasSubFolders;
+    };
+    auto subFolders = std::make_shared<QHash<QString, QVector<SyntheticFolder>>>(); // by parent path
+
+    SyntheticData generator(seed);
+    const QVector<int> folderSizes = generator.zipfSizes(folderCount, qint64(folderCount) * emailsPerFolder);
+    struct Parent
+    {
+        QString path;
+        int level;
+        QString parentPath; // to find the parent's own SyntheticFolder
+        int row;
+    };
+    std::deque<Parent> parents{{QString(), 0, QString(), -1}};
+    int createdCount = 0;
+    while (createdCount < folderCount) {
+        Parent parent{QString(), 0, QString(), -1};
+        int childCount = folderCount - createdCount; // if the tree is full already, put the rest at the top level
+        if (!parents.empty()) {
+            parent = parents.front();
+            parents.pop_front();
+            childCount = std::min(childCount, parent.level == 0 ? fanout : generator.skewed(0, 4 * fanout));
+        }
+        if (childCount == 0)
+            continue;
+        if (parent.row >= 0)
+            (*subFolders)[parent.parentPath][parent.row].hasSubFolders = true;
+        QVector<SyntheticFolder> &children = (*subFolders)[parent.path];
+        QSet<QString> names;
+        for (const SyntheticFolder &child : std::as_const(children))
+            names.insert(child.name);
+        for (int i = 0; i < childCount; ++i) {
+            QString name;
+            do {
+                name = generator.name();
+            } while (names.contains(name));
+            names.insert(name);
+            if (parent.level + 1 < depth)
+                parents.push_back({parent.path.isEmpty() ? name : parent.path + '/' + name, parent.level + 1, parent.path, int(children.size())});
+            children.append({name, folderSizes.at(createdCount++), false});
+        }
+    }
+
+    auto senders = std::make_shared<QStringList>();
+    for (int i = 0; i < 500; ++i)
+        senders->append(generator.name() + ' ' + generator.name(2, 3));
+
+    return [subFolders, senders, seed](const QString &path, EmailStore &emailStore) {
+        // A fixed date rather than the current one, so that the data is the same every time
+        const qint64 now = QDateTime::fromString(QStringLiteral("2024-06-03T12:00:00Z"), Qt::ISODate).toMSecsSinceEpoch();
+        const QVector<SyntheticFolder> folders = subFolders->value(path);
+        QVector<EmailFolderLoader::Folder> result;
+        result.reserve(folders.size());
+        for (const SyntheticFolder &folder : folders) {
+            SyntheticData generator(SyntheticData::seedFor(seed, path.isEmpty() ? folder.name : path + '/' + folder.name));
+            EmailFolderLoader::Folder loadedFolder{folder.name, {}, folder.hasSubFolders};
+            loadedFolder.emails.reserve(folder.emailCount);
+            for (int i = 0; i < folder.emailCount; ++i) {
+                quint64 flags = EmailStore::NoFlags;
+                if (generator.chance(0.1))
+                    flags |= EmailStore::Unread;
+                if (generator.chance(0.02))
+                    flags |= EmailStore::Flagged;
+                if (generator.chance(0.15))
+                    flags |= EmailStore::HasAttachment;
+                const qint64 age = qint64(generator.skewed(0, 5 * 365 * 24 * 3600)) * 1000; // mostly recent emails
+                const qint64 size = (flags & EmailStore::HasAttachment) ? generator.skewed(20000, 20000000) : generator.skewed(500, 50000);
+                const QString &sender = senders->at(generator.skewed(0, int(senders->size()) - 1)); // some write a lot
+                loadedFolder.emails.append(emailStore.addEmail(generator.sentence(2, 8), sender, now - age, size, flags));
+            }
+            result.append(loadedFolder);
+        }
+        return result;
+    };
+}
+
+class TopLevel : public QWidget
+{
+public:
+    // Shows the emails of the maildir at `maildirPath`, or the data listed by `listSubFolders` if empty.
+    // Changes to that data are saved in `journalPath`, if set.
+    explicit TopLevel(const QString &maildirPath = QString(), const QString &journalPath = QString(),
+                      const EmailFolderLoader::ListSubFolders &listSubFolders = listDemoSubFolders);
+
+private:
+    void showFolder(EmailFolder *folder);
+    void addLoadedFolders(const EmailFolderLoader::Batch &batch);
+    void compactJournal();
+
+    // Application data
+    EmailStore m_emailStore;
+    std::unique_ptr<EmailFolder> m_emails = std::make_unique<EmailFolder>(EmailFolder{"HIDDEN ROOT"});
+    EmailIndex m_emailIndex{&m_emailStore};
+    EmailFolderLoader m_loader;
+    std::unique_ptr<MaildirBackend> m_maildir;
+    std::unique_ptr<EmailJournal> m_journal;
+    int m_compactAfterRemovingFrom = -1; // the ID of the folder whose moved emails must be removed before compacting
+    // For the folders whose subfolders are loading: their IDs by path, and their paths by ID
+    QHash<QString, int> m_loadingFolders;
+    QHash<int, QString> m_loadingFolderPaths;
+    bool m_loaded = false; // the email store only changes while loading
 
     FoldersModel m_foldersModel;
     EmailsModel m_emailsModel;
+    EmailsProxyModel m_emailsProxyModel{&m_emailsModel};
+    SearchResultsModel m_searchResultsModel{&m_emailStore, &m_foldersModel};
+
+    // What the emails view looked like when leaving each folder, by folder ID.
+    // Email IDs rather than rows: the emails of the folder can change, and the sorting and filtering too.
+    struct EmailsViewState
+    {
+        int topEmailId = -1;
+        int currentEmailId = -1;
+        QVector<int> selectedEmailIds;
+    };
+    QHash<int, EmailsViewState> m_emailsViewStates;
+    QAbstractItemView *m_emailsView = nullptr;
 };
 
-static void setParentFolders(EmailFolder &folder) // recursive helper
+// Switches the emails view to another folder, restoring its scroll position, selection
+// and current item as they were when that folder was last shown
+void TopLevel::showFolder(EmailFolder *folder)
 {
-    for (EmailFolder &childFolder : folder.subFolders)
-    {
-        childFolder.parentFolder = &folder;
-        setParentFolders(childFolder);
+    // The view's model is m_emailsProxyModel, possibly wrapped in an InstrumentedModel which doesn't change the rows
+    QAbstractItemModel *model = m_emailsView->model();
+    QItemSelectionModel *selectionModel = m_emailsView->selectionModel();
+    const auto emailIdForIndex = [this](const QModelIndex &index) {
+        if (!index.isValid())
+            return -1;
+        return m_emailsModel.emailId(m_emailsProxyModel.mapToSource(m_emailsProxyModel.index(index.row(), 0)).row());
+    };
+    if (EmailFolder *previousFolder = m_emailsModel.emailFolder()) {
+        EmailsViewState state;
+        state.topEmailId = emailIdForIndex(m_emailsView->indexAt(QPoint(0, 0)));
+        state.currentEmailId = emailIdForIndex(selectionModel->currentIndex());
+        const QModelIndexList selectedIndexes = selectionModel->selectedRows();
+        state.selectedEmailIds.reserve(selectedIndexes.size());
+        for (const QModelIndex &index : selectedIndexes)
+            state.selectedEmailIds.append(emailIdForIndex(index));
+        m_emailsViewStates.insert(previousFolder->id, state);
+    }
+
+    m_emailsModel.setEmails(folder);
+
+    const EmailsViewState state = folder ? m_emailsViewStates.value(folder->id) : EmailsViewState();
+    // Emails which were moved out of the folder since, or are filtered out now, are skipped
+    QSet<int> emailIds(state.selectedEmailIds.cbegin(), state.selectedEmailIds.cend());
+    emailIds.insert(state.topEmailId);
+    emailIds.insert(state.currentEmailId);
+    emailIds.remove(-1);
+    const QHash<int, int> sourceRows = m_emailsModel.rowsForEmails(emailIds);
+    const auto rowForEmailId = [&](int emailId) {
+        const auto it = sourceRows.constFind(emailId);
+        if (it == sourceRows.cend())
+            return -1;
+        return m_emailsProxyModel.mapFromSource(m_emailsModel.index(it.value(), 0)).row();
+    };
+
+    QVector<int> selectedRows;
+    selectedRows.reserve(state.selectedEmailIds.size());
+    for (int emailId : state.selectedEmailIds) {
+        const int row = rowForEmailId(emailId);
+        if (row >= 0)
+            selectedRows.append(row);
+    }
+    std::sort(selectedRows.begin(), selectedRows.end());
+    // One range per run of consecutive rows, rather than one per row
+    QItemSelection selection;
+    for (int i = 0; i < selectedRows.size();) {
+        const int firstRow = selectedRows.at(i);
+        int lastRow = firstRow;
+        while (++i < selectedRows.size() && selectedRows.at(i) == lastRow + 1)
+            ++lastRow;
+        selection.select(model->index(firstRow, 0), model->index(lastRow, 0));
+    }
+    selectionModel->select(selection, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+    const int currentRow = rowForEmailId(state.currentEmailId);
+    selectionModel->setCurrentIndex(currentRow >= 0 ? model->index(currentRow, 0) : QModelIndex(), QItemSelectionModel::NoUpdate);
+    const int topRow = rowForEmailId(state.topEmailId);
+    if (topRow >= 0)
+        m_emailsView->scrollTo(model->index(topRow, 0), QAbstractItemView::PositionAtTop);
+}
+
+// In the GUI thread, with the result of one step of the loading
+void TopLevel::addLoadedFolders(const EmailFolderLoader::Batch &batch)
+{
+    EmailFolder *parentFolder = nullptr;
+    if (!batch.path.isEmpty()) {
+        const auto it = m_loadingFolders.find(batch.path);
+        if (it == m_loadingFolders.end())
+            return;
+        parentFolder = m_foldersModel.folderForId(it.value());
+        m_loadingFolderPaths.remove(it.value());
+        m_loadingFolders.erase(it);
+        if (!parentFolder)
+            return; // deleted by the user in the meantime
+    }
+
+    const int idOffset = m_emailStore.append(batch.emailStore);
+    std::vector<std::unique_ptr<EmailFolder>> folders;
+    folders.reserve(batch.folders.size());
+    for (const EmailFolderLoader::Folder &loadedFolder : batch.folders) {
+        auto folder = std::make_unique<EmailFolder>();
+        folder->folderName = loadedFolder.name;
+        folder->emails.reserve(loadedFolder.emails.size());
+        for (int emailId : loadedFolder.emails)
+            folder->emails.append(idOffset + emailId);
+        folder->subFoldersLoading = loadedFolder.hasSubFolders;
+        folders.push_back(std::move(folder));
+    }
+
+    if (!parentFolder) {
+        // The top-level folders: swap the whole tree at once
+        auto rootFolder = std::make_unique<EmailFolder>(EmailFolder{"HIDDEN ROOT"});
+        for (auto &folder : folders) {
+            folder->parentFolder = rootFolder.get();
+            folder->row = int(rootFolder->subFolders.size());
+            rootFolder->subFolders.push_back(std::move(folder));
+        }
+        m_emailsModel.setEmails(nullptr);
+        m_foldersModel.setEmailFolders(rootFolder.get());
+        m_emails = std::move(rootFolder); // deletes the previous folders, no longer used by the models
+        parentFolder = m_emails.get();
+        showFolder(parentFolder->subFolders.empty() ? nullptr : parentFolder->subFolders.front().get());
+    } else {
+        m_foldersModel.insertLoadedFolders(parentFolder, std::move(folders));
+    }
+
+    // The folders at the end of parentFolder->subFolders are the new ones
+    const auto &subFolders = parentFolder->subFolders;
+    for (auto it = subFolders.cend() - batch.folders.size(); it != subFolders.cend(); ++it) {
+        const EmailFolder *folder = it->get();
+        const QString path = batch.path.isEmpty() ? folder->folderName : batch.path + '/' + folder->folderName;
+        if (folder->subFoldersLoading) {
+            m_loadingFolders.insert(path, folder->id);
+            m_loadingFolderPaths.insert(folder->id, path);
+        }
+        if (m_maildir)
+            m_maildir->setFolderPath(folder->id, path);
     }
 }
 
-TopLevel::TopLevel()
+// Snapshots the current state, so that the journal doesn't grow forever
+void TopLevel::compactJournal()
+{
+    if (m_journal && m_loaded)
+        m_journal->compact(m_emailStore, *m_emails);
+}
+
+TopLevel::TopLevel(const QString &maildirPath, const QString &journalPath, const EmailFolderLoader::ListSubFolders &listSubFolders)
 {
-    setParentFolders(m_emails);
-    m_foldersModel.setEmailFolders(&m_emails);
+    m_emailsModel.setEmailStore(&m_emailStore);
+    m_foldersModel.setEmailFolders(m_emails.get()); // empty until the top-level folders are loaded
+
+    connect(&m_loader, &EmailFolderLoader::subFoldersLoaded, this, &TopLevel::addLoadedFolders);
+    connect(&m_loader, &EmailFolderLoader::finished, this, [this] {
+        // The store won't change anymore, it can be read from the indexing and journal threads
+        m_loaded = true;
+        m_emailIndex.build(m_emails.get());
+        compactJournal();
+    });
+    connect(&m_foldersModel, &FoldersModel::subFoldersRequested, this, [this](EmailFolder *folder) {
+        const QString path = m_loadingFolderPaths.value(folder->id);
+        if (!path.isEmpty())
+            m_loader.prioritize(path);
+    });
+
+    // Keeping everyone up to date when emails are moved around
+    connect(&m_emailsModel, &EmailsModel::emailsAboutToBeRemoved, &m_emailIndex, &EmailIndex::removeEmails);
+    connect(&m_emailsModel, &EmailsModel::emailsRemoved, this, [this](EmailFolder *folder, int row, int count) {
+        Q_UNUSED(row);
+        m_foldersModel.emailCountChanged(folder, -count);
+    });
+    connect(&m_foldersModel, &FoldersModel::emailsAppended, &m_emailsModel, &EmailsModel::notifyEmailsAppended);
+    connect(&m_foldersModel, &FoldersModel::emailsAppended, &m_emailIndex, &EmailIndex::addEmails);
+    connect(&m_foldersModel, &FoldersModel::emailsAboutToBeRemoved, &m_emailsModel, &EmailsModel::notifyEmailsAboutToBeRemoved);
+    connect(&m_foldersModel, &FoldersModel::emailsAboutToBeRemoved, &m_emailIndex, &EmailIndex::removeEmails);
+    connect(&m_foldersModel, &FoldersModel::emailsRemoved, &m_emailsModel, &EmailsModel::notifyEmailsRemoved);
+    connect(&m_foldersModel, &FoldersModel::folderAboutToBeDeleted, this, [this](EmailFolder *folder) {
+        if (isSameOrDescendant(m_emailsModel.emailFolder(), folder))
+            m_emailsModel.setEmails(nullptr);
+        m_emailIndex.removeFolder(folder);
+    });
 
     auto layout = new QHBoxLayout(this);
 
-    // Drop side (left)
+    // Drop side (left), with the search in all folders below
+    auto foldersLayout = new QVBoxLayout;
+    layout->addLayout(foldersLayout);
     const auto setupFoldersView = [&](QAbstractItemView *view) {
-        layout->addWidget(view);
+        foldersLayout->addWidget(view);
         view->setSelectionMode(QAbstractItemView::ExtendedSelection);
 
-        // Note: this takes care of setAcceptDrops(true)
-        view->setDragDropMode(QAbstractItemView::DropOnly);
-        view->setModel(&m_foldersModel);
+        // Note: this takes care of setDragEnabled(true) + setAcceptDrops(true)
+        // Dropping emails onto folders, and dragging folders to reorganize the hierarchy
+        view->setDragDropMode(QAbstractItemView::DragDrop);
+        view->setDefaultDropAction(Qt::MoveAction);
+        view->setModel(InstrumentedModel::instrument(&m_foldersModel, "FoldersModel"));
         // Minor improvement: no forbidden cursor when moving the drag between folders
         view->setDragDropOverwriteMode(true);
 
-        connect(view, &QAbstractItemView::clicked, view, [&](const QModelIndex &index) {
-            m_emailsModel.setEmails(m_foldersModel.folderForIndex(index));
+        connect(view, &QAbstractItemView::clicked, view, [this](const QModelIndex &index) {
+            showFolder(m_foldersModel.folderForIndex(InstrumentedModel::sourceIndex(index)));
+        });
+
+        // Creating and deleting folders
+        view->setContextMenuPolicy(Qt::CustomContextMenu);
+        connect(view, &QWidget::customContextMenuRequested, view, [this, view](const QPoint &pos) {
+            const QModelIndex index = InstrumentedModel::sourceIndex(view->indexAt(pos));
+            EmailFolder *folder = m_foldersModel.folderForIndex(index); // the hidden root folder, below the last item
+            QMenu menu;
+            QAction *newFolderAction = menu.addAction("New Folder...");
+            QAction *deleteFolderAction = index.isValid() ? menu.addAction("Delete Folder") : nullptr;
+            QAction *action = menu.exec(view->viewport()->mapToGlobal(pos));
+            if (!action) {
+                return;
+            } else if (action == newFolderAction) {
+                const QString folderName = QInputDialog::getText(this, "New Folder", "Folder name:");
+                if (!folderName.isEmpty())
+                    m_foldersModel.createFolder(folder, folderName);
+            } else if (action == deleteFolderAction) {
+                m_foldersModel.deleteFolder(folder);
+            }
         });
-        m_emailsModel.setEmails(&m_emails.subFolders[0]);
     };
 
-    // Drag side (right)
+    // Drag side (right), with filtering widgets above the view
+    auto emailsLayout = new QVBoxLayout;
+    layout->addLayout(emailsLayout);
+    auto searchLineEdit = new QLineEdit;
+    searchLineEdit->setPlaceholderText("Search subjects and senders");
+    searchLineEdit->setClearButtonEnabled(true);
+    connect(searchLineEdit, &QLineEdit::textChanged, &m_emailsProxyModel, &EmailsProxyModel::setSearchText);
+    emailsLayout->addWidget(searchLineEdit);
+    auto unreadCheckBox = new QCheckBox("Unread only");
+    connect(unreadCheckBox, &QCheckBox::toggled, this, [this](bool checked) {
+        m_emailsProxyModel.setRequiredFlags(checked ? EmailStore::Unread : EmailStore::NoFlags);
+    });
+    emailsLayout->addWidget(unreadCheckBox);
+
     const auto setupEmailsView = [&](QAbstractItemView *view) {
-        layout->addWidget(view);
+        emailsLayout->addWidget(view);
         view->setSelectionMode(QAbstractItemView::ExtendedSelection);
         view->setDragDropMode(QAbstractItemView::DragOnly);
         // When moving, delete the source, don't just clear it (QTableView)
         view->setDragDropOverwriteMode(false);
         // Don't be confused by the method name, this sets the default action on the drag side
         view->setDefaultDropAction(Qt::MoveAction);
-        view->setMaximumWidth(400);
-        view->setModel(&m_emailsModel);
+        view->setMaximumWidth(600);
+        view->setModel(InstrumentedModel::instrument(&m_emailsProxyModel, "EmailsModel"));
+        m_emailsView = view;
     };
 
     setWindowTitle("Dropping onto QTreeView items");
@@ -363,24 +2566,124 @@ TopLevel::TopLevel()
     auto emailsTreeView = new QTreeView;
     setupEmailsView(emailsTreeView);
 
-    foldersTreeView->expandAll();
     foldersTreeView->setAutoExpandDelay(100);
     foldersTreeView->header()->setSectionResizeMode(0, QHeaderView::Stretch);
-    foldersTreeView->header()->resizeSection(1, 80);
+    foldersTreeView->header()->resizeSection(FoldersModel::NumEmails, 80);
+    foldersTreeView->header()->resizeSection(FoldersModel::TotalEmails, 80);
     foldersTreeView->header()->setStretchLastSection(false);
+
+    auto searchAllLineEdit = new QLineEdit;
+    searchAllLineEdit->setPlaceholderText("Search all folders");
+    searchAllLineEdit->setClearButtonEnabled(true);
+    foldersLayout->addWidget(searchAllLineEdit);
+    auto searchResultsView = new QTreeView;
+    searchResultsView->setRootIsDecorated(false);
+    searchResultsView->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    searchResultsView->setDragDropMode(QAbstractItemView::DragOnly);
+    searchResultsView->setDefaultDropAction(Qt::MoveAction);
+    searchResultsView->setModel(InstrumentedModel::instrument(&m_searchResultsModel, "SearchResultsModel"));
+    foldersLayout->addWidget(searchResultsView);
+    const auto search = [this, searchAllLineEdit] {
+        m_searchResultsModel.setResults(m_emailIndex.search(searchAllLineEdit->text()));
+    };
+    // Wait for a pause in the typing: the results for each intermediate prefix would be thrown away anyway
+    auto searchTimer = new QTimer(this);
+    searchTimer->setSingleShot(true);
+    searchTimer->setInterval(150);
+    connect(searchAllLineEdit, &QLineEdit::textChanged, searchTimer, qOverload<>(&QTimer::start));
+    connect(searchTimer, &QTimer::timeout, this, search);
+    // Queued, so that the results aren't reset in the middle of dragging them
+    connect(&m_emailIndex, &EmailIndex::changed, this, search, Qt::QueuedConnection);
+
+    if (maildirPath.isEmpty()) {
+        if (!journalPath.isEmpty()) {
+            m_journal = std::make_unique<EmailJournal>(journalPath);
+            m_journal->recordChanges(&m_foldersModel); // before the connection below, so that the transfer is recorded first
+            connect(m_journal.get(), &EmailJournal::error, this, [this](const QString &message) {
+                QMessageBox::warning(this, "Saving Changes", message);
+            });
+            connect(&m_foldersModel, &FoldersModel::emailsTransferred, this,
+                    [this](EmailFolder *sourceFolder, EmailFolder *destFolder, const QVector<int> &emailIds, Qt::DropAction action) {
+                        Q_UNUSED(destFolder);
+                        Q_UNUSED(emailIds);
+                        if (m_journal->recordsSinceSnapshot() <= 1000)
+                            return;
+                        // When moving, not before the emails are removed from the source folder: the snapshot
+                        // would have them in both folders
+                        if (action == Qt::MoveAction)
+                            m_compactAfterRemovingFrom = sourceFolder->id;
+                        else
+                            compactJournal();
+                    });
+            const auto compactAfterMove = [this](EmailFolder *folder) {
+                if (folder->id != m_compactAfterRemovingFrom)
+                    return;
+                m_compactAfterRemovingFrom = -1;
+                compactJournal();
+            };
+            connect(&m_emailsModel, &EmailsModel::emailsRemoved, this, compactAfterMove);
+            connect(&m_foldersModel, &FoldersModel::emailsRemoved, this, compactAfterMove);
+            auto rootFolder = std::make_unique<EmailFolder>(EmailFolder{"HIDDEN ROOT"});
+            if (m_journal->restore(m_emailStore, *rootFolder)) {
+                // No need to load the demo data again
+                m_foldersModel.setEmailFolders(rootFolder.get());
+                m_emails = std::move(rootFolder);
+                showFolder(m_emails->subFolders.empty() ? nullptr : m_emails->subFolders.front().get());
+                m_loaded = true;
+                m_emailIndex.build(m_emails.get());
+                compactJournal(); // includes the replayed journal into the snapshot
+            }
+        }
+        if (!m_loaded)
+            m_loader.start(listSubFolders);
+    } else {
+        m_maildir = std::make_unique<MaildirBackend>(maildirPath);
+        connect(&m_foldersModel, &FoldersModel::emailsTransferred, this,
+                [this](EmailFolder *sourceFolder, EmailFolder *destFolder, const QVector<int> &emailIds, Qt::DropAction action,
+                       const QVector<int> &appendedEmailIds) {
+                    m_maildir->transferEmails(sourceFolder, destFolder, emailIds, action, appendedEmailIds, m_emailStore);
+                });
+        m_loader.start(m_maildir->subFolderLister());
+    }
+    emailsTreeView->setRootIsDecorated(false);
+    emailsTreeView->setSortingEnabled(true);
+    emailsTreeView->sortByColumn(EmailsModel::Date, Qt::DescendingOrder);
     emailsTreeView->header()->resizeSections(QHeaderView::ResizeToContents);
 }
 
+// The benchmarks include this file, with their own main()
+#ifndef DND_BENCHMARK
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
-    auto topLevel = new TopLevel();
-    topLevel->resize(700, 400);
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("maildir", "The path to a maildir tree (optional, shows demo data otherwise)", "[maildir]");
+    const QCommandLineOption journalOption("journal", "Save the changes made to the demo data in <directory>", "directory");
+    parser.addOption(journalOption);
+    const SyntheticDataOptions syntheticDataOptions;
+    parser.addOptions({syntheticDataOptions.folders, syntheticDataOptions.emailsPerFolder, syntheticDataOptions.depth,
+                       syntheticDataOptions.fanout, syntheticDataOptions.seed});
+    parser.process(app);
+
+    EmailFolderLoader::ListSubFolders listSubFolders = listDemoSubFolders;
+    if (parser.isSet(syntheticDataOptions.folders)) {
+        listSubFolders = syntheticSubFolderLister(SyntheticDataOptions::intValue(parser, syntheticDataOptions.folders),
+                                                  parser.isSet(syntheticDataOptions.depth) ? SyntheticDataOptions::intValue(parser, syntheticDataOptions.depth) : 3,
+                                                  SyntheticDataOptions::intValue(parser, syntheticDataOptions.fanout),
+                                                  SyntheticDataOptions::intValue(parser, syntheticDataOptions.emailsPerFolder),
+                                                  SyntheticDataOptions::intValue(parser, syntheticDataOptions.seed));
+    }
+
+    const QStringList args = parser.positionalArguments();
+    auto topLevel = new TopLevel(args.value(0), parser.value(journalOption), listSubFolders);
+    topLevel->resize(1000, 400);
     topLevel->show();
     topLevel->setAttribute(Qt::WA_DeleteOnClose);
 
     return app.exec();
 }
+#endif
 
 #include "drop-onto-items-with-treemodel.moc"
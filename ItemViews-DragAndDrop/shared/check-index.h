@@ -0,0 +1,204 @@
+/* MIT License
+
+Copyright (C) 2020 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <QAbstractItemModel>
+#include <QByteArray>
+
+// Validation levels, for when the checks below dominate the profiles of debug builds with large models:
+//   0 (off):     no checks at all
+//   1 (sampled): the full checks, but only on one call in CHECK_INDEX_SAMPLE_INTERVAL (100 by default)
+//   2 (cheap):   only checks what can be checked without calling rowCount(), columnCount() or parent().
+//                Note that checkIndex() calls rowCount(index.parent()), which in a tree model checks the parent,
+//                which calls rowCount() of the grandparent and so on: this is where the time goes with deep trees.
+//   3 (full):    everything (the default in debug builds)
+// Select the level at compile time with -DCHECK_INDEX_LEVEL=<n>, or at runtime with the CHECK_INDEX_LEVEL
+// environment variable: off, sampled, sampled:<interval>, cheap or full.
+// Level 0 at compile time removes the checks entirely (this is the default when building in release mode).
+#ifndef CHECK_INDEX_LEVEL
+#ifdef QT_NO_DEBUG
+#define CHECK_INDEX_LEVEL 0
+#else
+#define CHECK_INDEX_LEVEL 3
+#endif
+#endif
+
+#ifndef CHECK_INDEX_SAMPLE_INTERVAL
+#define CHECK_INDEX_SAMPLE_INTERVAL 100
+#endif
+
+namespace CheckIndex {
+enum Level { Off, Sampled, Cheap, Full };
+
+struct Settings
+{
+    Level level;
+    int sampleInterval;
+};
+
+inline Settings readSettings()
+{
+    Settings settings{Level(CHECK_INDEX_LEVEL), CHECK_INDEX_SAMPLE_INTERVAL};
+    const QByteArray value = qgetenv("CHECK_INDEX_LEVEL");
+    if (value == "off") {
+        settings.level = Off;
+    } else if (value == "sampled" || value.startsWith("sampled:")) {
+        settings.level = Sampled;
+        if (value.size() > 8)
+            settings.sampleInterval = qMax(1, value.mid(8).toInt());
+    } else if (value == "cheap") {
+        settings.level = Cheap;
+    } else if (value == "full") {
+        settings.level = Full;
+    } else if (!value.isEmpty()) {
+        qWarning("CHECK_INDEX_LEVEL should be off, sampled, sampled:<interval>, cheap or full, not %s", value.constData());
+    }
+    return settings;
+}
+
+// How much to check in this call: Off, Cheap or Full (the calls picked by sampling are checked fully)
+inline Level levelForThisCall()
+{
+    static const Settings settings = readSettings();
+    if (settings.level != Sampled)
+        return settings.level;
+    static int calls = 0; // models live in the GUI thread, no need for an atomic
+    if (++calls < settings.sampleInterval)
+        return Off;
+    calls = 0;
+    return Full;
+}
+
+inline QAbstractItemModel::CheckIndexOptions options(Level level, QAbstractItemModel::CheckIndexOptions options = {})
+{
+    if (level == Cheap)
+        options |= QAbstractItemModel::CheckIndexOption::DoNotUseParent;
+    return options;
+}
+}
+
+// Runs the checks given as arguments, if any checking is to be done in this call. In there, `checkLevel` is
+// the level for this call, and CHECK_INDEX_FULL_ONLY(...) runs the checks which are too expensive for the cheap level.
+// With CHECK_INDEX_LEVEL 0 the compiler removes everything, but the arguments are still seen as used.
+#define CHECK_INDEX_CHECKS(...)                                                                    \
+    do {                                                                                           \
+        const CheckIndex::Level checkLevel =                                                       \
+            CHECK_INDEX_LEVEL > 0 ? CheckIndex::levelForThisCall() : CheckIndex::Off;              \
+        if (checkLevel != CheckIndex::Off) {                                                       \
+            __VA_ARGS__;                                                                           \
+        }                                                                                          \
+    } while (false)
+
+#define CHECK_INDEX_FULL_ONLY(...)                                                                 \
+    if (checkLevel == CheckIndex::Full) {                                                          \
+        __VA_ARGS__;                                                                               \
+    }
+
+#define CHECK_rowCount(index) CHECK_INDEX_CHECKS(Q_ASSERT(checkIndex(index, CheckIndex::options(checkLevel))))
+
+#define CHECK_columnCount(index) CHECK_INDEX_CHECKS(Q_ASSERT(checkIndex(index, CheckIndex::options(checkLevel))))
+
+#define CHECK_data(index)                                                                          \
+    CHECK_INDEX_CHECKS(                                                                            \
+        if (checkLevel == CheckIndex::Full                                                         \
+            && (qobject_cast<const QAbstractTableModel *>(this)                                    \
+                || qobject_cast<const QAbstractListModel *>(this)))                                \
+            Q_ASSERT(checkIndex(index,                                                             \
+                                QAbstractItemModel::CheckIndexOption::IndexIsValid                 \
+                                    | QAbstractItemModel::CheckIndexOption::ParentIsInvalid));     \
+        else                                                                                       \
+            Q_ASSERT(checkIndex(index,                                                             \
+                                CheckIndex::options(checkLevel,                                    \
+                                                    QAbstractItemModel::CheckIndexOption::IndexIsValid))))
+
+#define CHECK_setData(index) CHECK_data(index)
+
+#define CHECK_headerData(section, orientation)                                                     \
+    CHECK_INDEX_CHECKS(                                                                            \
+        Q_ASSERT(section >= 0);                                                                    \
+        CHECK_INDEX_FULL_ONLY(                                                                     \
+            if (orientation == Qt::Horizontal)                                                     \
+                Q_ASSERT(section < columnCount({}));                                               \
+            else                                                                                   \
+                Q_ASSERT(section < rowCount({}))))
+
+#define CHECK_setHeaderData(section, orientation) CHECK_headerData(section, orientation)
+
+#define CHECK_flags(index) CHECK_INDEX_CHECKS(Q_ASSERT(checkIndex(index, CheckIndex::options(checkLevel))))
+
+// If you get an assert for row or column being zero and rowCount() and columnCount() is zero too,
+// then there is a chance that it is a subclass of QAbstractProxyModel::headerData making this out
+// of bound call. The cure is to implement headerData in the subclass of QAbstractProxyModel, and
+// while doing so /not/ use mapToSource for finding the row or column in the source model.
+#define CHECK_index(row, column, parent)                                                           \
+    CHECK_INDEX_CHECKS(                                                                            \
+        Q_ASSERT(row >= 0);                                                                        \
+        Q_ASSERT(column >= 0);                                                                     \
+        CHECK_INDEX_FULL_ONLY(Q_ASSERT(row < rowCount(parent));                                    \
+                              Q_ASSERT(column < columnCount(parent)));                             \
+        Q_ASSERT(checkIndex(parent, CheckIndex::options(checkLevel))))
+
+#define CHECK_parent(parent)                                                                       \
+    CHECK_INDEX_CHECKS(Q_ASSERT(checkIndex(parent, QAbstractItemModel::CheckIndexOption::DoNotUseParent)))
+
+#define CHECK_insertRows(row, count, parent)                                                       \
+    CHECK_INDEX_CHECKS(                                                                            \
+        Q_ASSERT(checkIndex(parent, CheckIndex::options(checkLevel)));                             \
+        Q_ASSERT(row >= 0);                                                                        \
+        CHECK_INDEX_FULL_ONLY(Q_ASSERT(row <= rowCount(parent)));                                  \
+        Q_ASSERT(count > 0))
+
+// Technically it might be OK to call removeRows with count == 0, so you might
+// consider taking that out and making it a check in your code instead.
+#define CHECK_removeRows(row, count, parent)                                                       \
+    CHECK_INDEX_CHECKS(                                                                            \
+        Q_ASSERT(checkIndex(parent, CheckIndex::options(checkLevel)));                             \
+        Q_ASSERT(row >= 0);                                                                        \
+        Q_ASSERT(count > 0);                                                                       \
+        CHECK_INDEX_FULL_ONLY(Q_ASSERT(row <= rowCount(parent) - count)))
+
+#define CHECK_insertColumns(column, count, parent)                                                 \
+    CHECK_INDEX_CHECKS(                                                                            \
+        Q_ASSERT(checkIndex(parent, CheckIndex::options(checkLevel)));                             \
+        Q_ASSERT(column >= 0);                                                                     \
+        CHECK_INDEX_FULL_ONLY(Q_ASSERT(column <= columnCount(parent)));                            \
+        Q_ASSERT(count > 0))
+
+// Same as removeRows above.
+#define CHECK_removeColumns(column, count, parent)                                                 \
+    CHECK_INDEX_CHECKS(                                                                            \
+        Q_ASSERT(checkIndex(parent, CheckIndex::options(checkLevel)));                             \
+        Q_ASSERT(column >= 0);                                                                     \
+        Q_ASSERT(count > 0);                                                                       \
+        CHECK_INDEX_FULL_ONLY(Q_ASSERT(column <= columnCount(parent) - count)))
+
+#define CHECK_moveRows(sourceParent, sourceRow, count, destinationParent, destinationChild)        \
+    CHECK_INDEX_CHECKS(                                                                            \
+        Q_ASSERT(checkIndex(sourceParent, CheckIndex::options(checkLevel)));                       \
+        Q_ASSERT(checkIndex(destinationParent, CheckIndex::options(checkLevel)));                  \
+        Q_ASSERT(sourceRow >= 0);                                                                  \
+        Q_ASSERT(count > 0);                                                                       \
+        CHECK_INDEX_FULL_ONLY(Q_ASSERT(sourceRow <= rowCount(sourceParent) - count));              \
+        Q_ASSERT(destinationChild >= 0);                                                           \
+        CHECK_INDEX_FULL_ONLY(Q_ASSERT(destinationChild <= rowCount(destinationParent))))
@@ -0,0 +1,252 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QPair>
+#include <QSaveFile>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtEndian>
+
+#include <algorithm>
+#include <vector>
+
+// Maps view rows to positions in an underlying store, as a list of "pieces"
+// (runs of consecutive positions), like the piece table of a text editor.
+// Initially a single piece covers the whole store, so creating it is O(1) whatever the size.
+// Moving, inserting or removing rows only splits and splices pieces: the data itself
+// never moves, and the cost depends on the number of pieces (i.e. on the number of
+// previous edits), not on the number of rows.
+class RowOverlay
+{
+public:
+    void reset(qint64 count)
+    {
+        m_pieces.clear();
+        m_firstRows.clear();
+        if (count > 0) {
+            m_pieces.push_back({0, count});
+            m_firstRows.push_back(0);
+        }
+    }
+
+    qint64 rowCount() const { return m_pieces.empty() ? 0 : m_firstRows.back() + m_pieces.back().count; }
+
+    qint64 positionForRow(qint64 row) const
+    {
+        const int i = pieceContaining(row);
+        return m_pieces.at(i).start + (row - m_firstRows.at(i));
+    }
+
+    // Inserts `count` rows at `row`, showing the positions [start, start + count)
+    void insert(qint64 row, qint64 start, qint64 count)
+    {
+        const int i = splitAt(row);
+        if (i > 0 && m_pieces.at(i - 1).start + m_pieces.at(i - 1).count == start) {
+            // Extend the previous piece, so that inserting rows one by one doesn't create one piece per row
+            m_pieces[i - 1].count += count;
+            updateFirstRows(i);
+            return;
+        }
+        m_pieces.insert(m_pieces.begin() + i, Piece{start, count});
+        m_firstRows.insert(m_firstRows.begin() + i, 0);
+        updateFirstRows(i);
+    }
+
+    void remove(qint64 row, qint64 count)
+    {
+        const int first = splitAt(row);
+        const int last = splitAt(row + count);
+        m_pieces.erase(m_pieces.begin() + first, m_pieces.begin() + last);
+        m_firstRows.erase(m_firstRows.begin() + first, m_firstRows.begin() + last);
+        updateFirstRows(first);
+    }
+
+    // Moves the rows [sourceRow, sourceRow + count) in front of destinationChild
+    // (numbered before the move, like in QAbstractItemModel::beginMoveRows)
+    void move(qint64 sourceRow, qint64 count, qint64 destinationChild)
+    {
+        // Splitting can insert pieces, so look up the piece indexes only once all splits are done
+        splitAt(sourceRow);
+        splitAt(sourceRow + count);
+        splitAt(destinationChild);
+        const int first = splitAt(sourceRow);
+        const int last = splitAt(sourceRow + count);
+        const int destination = splitAt(destinationChild);
+        const auto begin = m_pieces.begin();
+        if (destination > last)
+            std::rotate(begin + first, begin + last, begin + destination);
+        else
+            std::rotate(begin + destination, begin + first, begin + last);
+        updateFirstRows(std::min(first, destination));
+    }
+
+private:
+    struct Piece
+    {
+        qint64 start; // position of the first row of the piece, in the underlying store
+        qint64 count;
+    };
+
+    int pieceContaining(qint64 row) const
+    {
+        const auto it = std::upper_bound(m_firstRows.begin(), m_firstRows.end(), row);
+        return int(std::distance(m_firstRows.begin(), it)) - 1;
+    }
+
+    // Ensures that a piece starts at `row`, and returns its index
+    // (or the number of pieces, if `row` is the row count)
+    int splitAt(qint64 row)
+    {
+        if (row >= rowCount())
+            return int(m_pieces.size());
+        const int i = pieceContaining(row);
+        const qint64 offset = row - m_firstRows.at(i);
+        if (offset == 0)
+            return i;
+        Piece &piece = m_pieces[i];
+        const Piece tail{piece.start + offset, piece.count - offset};
+        piece.count = offset;
+        m_pieces.insert(m_pieces.begin() + i + 1, tail);
+        m_firstRows.insert(m_firstRows.begin() + i + 1, row);
+        return i + 1;
+    }
+
+    void updateFirstRows(int from)
+    {
+        qint64 row = from > 0 ? m_firstRows.at(from - 1) + m_pieces.at(from - 1).count : 0;
+        for (int i = from; i < int(m_pieces.size()); ++i) {
+            m_firstRows[i] = row;
+            row += m_pieces.at(i).count;
+        }
+    }
+
+    std::vector<Piece> m_pieces;
+    std::vector<qint64> m_firstRows; // the view row of the first row of each piece, for binary searching
+};
+
+// Country data read from a memory-mapped file of fixed-width records.
+// Opening the file is O(1): nothing is read until data is requested for a row, and the
+// operating system only pages in the parts of the file that are actually looked at.
+// The file itself is never modified, reordering goes into a RowOverlay, and rows dropped from
+// elsewhere are kept in memory, after the mapped records.
+class MappedCountries
+{
+public:
+    // On-disk format: the UTF-8 country name, zero-padded to 28 bytes,
+    // followed by the population (in millions) as a little-endian 32-bit integer.
+    struct Record
+    {
+        char country[28];
+        qint32 population;
+    };
+    static_assert(sizeof(Record) == 32, "unexpected padding in MappedCountries::Record");
+
+    bool open(const QString &fileName)
+    {
+        close();
+        m_file.setFileName(fileName);
+        if (!m_file.open(QIODevice::ReadOnly))
+            return false;
+        m_recordCount = m_file.size() / qint64(sizeof(Record));
+        if (m_recordCount > 0) {
+            m_records = reinterpret_cast<const Record *>(m_file.map(0, m_recordCount * qint64(sizeof(Record))));
+            if (!m_records) {
+                close();
+                return false;
+            }
+        }
+        m_overlay.reset(m_recordCount);
+        return true;
+    }
+
+    void close()
+    {
+        if (m_records)
+            m_file.unmap(reinterpret_cast<uchar *>(const_cast<Record *>(m_records)));
+        m_records = nullptr;
+        m_file.close();
+        m_recordCount = 0;
+        m_addedCountries.clear();
+        m_addedPopulations.clear();
+        m_overlay.reset(0);
+    }
+
+    bool isOpen() const { return m_file.isOpen(); }
+
+    int size() const { return int(m_overlay.rowCount()); }
+
+    QString country(int row) const
+    {
+        const qint64 position = m_overlay.positionForRow(row);
+        if (position >= m_recordCount)
+            return m_addedCountries.at(position - m_recordCount);
+        const Record &record = m_records[position];
+        return QString::fromUtf8(record.country, int(qstrnlen(record.country, sizeof(record.country))));
+    }
+
+    int population(int row) const
+    {
+        const qint64 position = m_overlay.positionForRow(row);
+        if (position >= m_recordCount)
+            return m_addedPopulations.at(position - m_recordCount);
+        return qFromLittleEndian(m_records[position].population);
+    }
+
+    void moveRows(int sourceRow, int count, int destinationChild) { m_overlay.move(sourceRow, count, destinationChild); }
+
+    void insertRow(int row, const QString &country, int population)
+    {
+        m_overlay.insert(row, m_recordCount + m_addedCountries.size(), 1);
+        m_addedCountries.append(country);
+        m_addedPopulations.append(population);
+    }
+
+    // Note that removed rows which had been added by insertRow() stay in memory until close()
+    void removeRows(int row, int count) { m_overlay.remove(row, count); }
+
+    // Creates a file that can be opened with open(), with `count` records. `generate(row)` returns the
+    // (country, population) pair of each row, and the records are written as they are generated,
+    // so that the file can be much bigger than the memory.
+    template<typename Generator>
+    static bool writeFile(const QString &fileName, qint64 count, Generator generate)
+    {
+        QSaveFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+        for (qint64 row = 0; row < count; ++row) {
+            const QPair<QString, int> record = generate(row);
+            if (!writeRecord(&file, record.first, record.second))
+                return false; // QSaveFile leaves any existing file untouched
+        }
+        return file.commit();
+    }
+
+    static bool writeRecord(QIODevice *device, const QString &country, int population)
+    {
+        Record record = {};
+        const QByteArray utf8 = country.toUtf8();
+        // Truncate without cutting a multibyte UTF-8 sequence in the middle, and keep a trailing '\0'
+        int length = std::min(int(utf8.size()), int(sizeof(record.country)) - 1);
+        while (length > 0 && length < utf8.size() && (uchar(utf8.at(length)) & 0xc0) == 0x80)
+            --length;
+        std::copy(utf8.constData(), utf8.constData() + length, record.country);
+        record.population = qToLittleEndian(qint32(population));
+        return device->write(reinterpret_cast<const char *>(&record), sizeof(record)) == qint64(sizeof(record));
+    }
+
+private:
+    QFile m_file;
+    const Record *m_records = nullptr;
+    qint64 m_recordCount = 0;
+    QStringList m_addedCountries;
+    QVector<int> m_addedPopulations;
+    RowOverlay m_overlay;
+};
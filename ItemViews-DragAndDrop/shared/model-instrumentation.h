@@ -0,0 +1,389 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+#pragma once
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QIdentityProxyModel>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMimeData>
+
+#include <map>
+#include <vector>
+
+struct AllocationCount
+{
+    quint64 count;
+    quint64 bytes;
+};
+
+// Counting the heap allocations made by each operation as well: define DND_COUNT_ALLOCATIONS, and add
+// benchmarks/allocation-counter.cpp to the sources, which replaces the global allocation functions (the benchmarks
+// are built that way). Only the allocations of the current thread (i.e. the GUI thread) are counted.
+#ifdef DND_COUNT_ALLOCATIONS
+AllocationCount countedAllocations(); // in benchmarks/allocation-counter.cpp
+#endif
+
+// The allocations made by the current thread so far, or nothing without DND_COUNT_ALLOCATIONS
+inline AllocationCount allocationsSoFar()
+{
+#ifdef DND_COUNT_ALLOCATIONS
+    return countedAllocations();
+#else
+    return {0, 0};
+#endif
+}
+
+// When a drop is slow, where does the time go: into our dropMimeData, into the number of signals it emits,
+// or into the views reacting to them? Put this proxy between a model and its views to find out.
+// It counts and times the DnD operations (mimeData, dropMimeData, removeRows, moveRows...), the model's signals
+// (including the time the views take to react to them) and the calls made by the views (index, data, rowCount...),
+// attributing each signal and call to the DnD operation running at the time.
+//
+// Enabled with the DND_INSTRUMENTATION environment variable:
+//   DND_INSTRUMENTATION=summary prints a summary when the application quits
+//   DND_INSTRUMENTATION=trace:<file> also writes the operations and signals as a Chrome trace (for chrome://tracing
+//   or https://ui.perfetto.dev), in <file> with the name of the model appended, e.g. trace-CountryModel.json
+// When built with DND_COUNT_ALLOCATIONS, the number of heap allocations and the bytes allocated are reported as well.
+class InstrumentedModel : public QIdentityProxyModel
+{
+public:
+    // Returns `model` itself when instrumentation is disabled, so that it costs nothing then
+    static QAbstractItemModel *instrument(QAbstractItemModel *model, const QString &name)
+    {
+        const QString setting = qEnvironmentVariable("DND_INSTRUMENTATION");
+        if (setting.isEmpty())
+            return model;
+        auto proxy = new InstrumentedModel(name, model); // deleted with the model
+        if (setting.startsWith(QLatin1String("trace:"))) {
+            const QFileInfo traceFile(setting.mid(6));
+            proxy->m_traceFileName = traceFile.path() + '/' + traceFile.completeBaseName() + '-' + name + QLatin1String(".json");
+        }
+        proxy->setSourceModel(model);
+        return proxy;
+    }
+
+    // For indexes coming from the views, e.g. in a slot connected to QAbstractItemView::clicked
+    static QModelIndex sourceIndex(const QModelIndex &index)
+    {
+        if (auto proxy = dynamic_cast<const InstrumentedModel *>(index.model()))
+            return proxy->mapToSource(index);
+        return index;
+    }
+
+    ~InstrumentedModel() override { report(); }
+
+    void setSourceModel(QAbstractItemModel *sourceModel) override
+    {
+        // Qt calls the slots connected to a signal in the order of the connections: connecting before and after
+        // QIdentityProxyModel (which forwards the signals to the views) measures how long the views take to react
+        connectSignals(sourceModel, &InstrumentedModel::signalStarted);
+        QIdentityProxyModel::setSourceModel(sourceModel);
+        connectSignals(sourceModel, &InstrumentedModel::signalFinished);
+        connect(qApp, &QCoreApplication::aboutToQuit, this, &InstrumentedModel::report);
+    }
+
+    // Calls made by the views
+    QModelIndex index(int row, int column, const QModelIndex &parent = {}) const override
+    {
+        const Call call(this, "index");
+        return QIdentityProxyModel::index(row, column, parent);
+    }
+    QModelIndex parent(const QModelIndex &child) const override
+    {
+        const Call call(this, "parent");
+        return QIdentityProxyModel::parent(child);
+    }
+    int rowCount(const QModelIndex &parent = {}) const override
+    {
+        const Call call(this, "rowCount");
+        return QIdentityProxyModel::rowCount(parent);
+    }
+    int columnCount(const QModelIndex &parent = {}) const override
+    {
+        const Call call(this, "columnCount");
+        return QIdentityProxyModel::columnCount(parent);
+    }
+    bool hasChildren(const QModelIndex &parent = {}) const override
+    {
+        const Call call(this, "hasChildren");
+        return QIdentityProxyModel::hasChildren(parent);
+    }
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
+    {
+        const Call call(this, "data");
+        return QIdentityProxyModel::data(index, role);
+    }
+    Qt::ItemFlags flags(const QModelIndex &index) const override
+    {
+        const Call call(this, "flags");
+        return QIdentityProxyModel::flags(index);
+    }
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override
+    {
+        const Call call(this, "headerData");
+        return QIdentityProxyModel::headerData(section, orientation, role);
+    }
+
+    // DnD operations
+    QMimeData *mimeData(const QModelIndexList &indexes) const override
+    {
+        const Operation operation(this, "mimeData");
+        return QIdentityProxyModel::mimeData(indexes);
+    }
+    bool canDropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent) const override
+    {
+        const Operation operation(this, "canDropMimeData");
+        return QIdentityProxyModel::canDropMimeData(data, action, row, column, parent);
+    }
+    bool dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent) override
+    {
+        const Operation operation(this, "dropMimeData");
+        return QIdentityProxyModel::dropMimeData(data, action, row, column, parent);
+    }
+    bool insertRows(int row, int count, const QModelIndex &parent = {}) override
+    {
+        const Operation operation(this, "insertRows");
+        return QIdentityProxyModel::insertRows(row, count, parent);
+    }
+    bool removeRows(int row, int count, const QModelIndex &parent = {}) override
+    {
+        const Operation operation(this, "removeRows");
+        return QIdentityProxyModel::removeRows(row, count, parent);
+    }
+    bool moveRows(const QModelIndex &sourceParent, int sourceRow, int count, const QModelIndex &destinationParent,
+                  int destinationChild) override
+    {
+        const Operation operation(this, "moveRows");
+        // The rows are the same as in the source model, only the parents need mapping
+        return sourceModel()->moveRows(mapToSource(sourceParent), sourceRow, count, mapToSource(destinationParent), destinationChild);
+    }
+
+private:
+    InstrumentedModel(const QString &name, QObject *parent)
+        : QIdentityProxyModel(parent)
+        , m_name(name)
+    {
+        m_clock.start();
+    }
+
+    struct Stats
+    {
+        qint64 count = 0;
+        qint64 nsecs = 0;
+        quint64 allocations = 0;
+        quint64 allocatedBytes = 0;
+    };
+
+    struct TraceEvent
+    {
+        const char *name;
+        const char *category;
+        qint64 startNsecs;
+        qint64 durationNsecs;
+        quint64 allocations;
+        quint64 allocatedBytes;
+    };
+
+    // The time and the allocations so far, for measuring what happens until the end of a call, operation or signal
+    struct Sample
+    {
+        qint64 nsecs;
+        quint64 allocations;
+        quint64 allocatedBytes;
+    };
+
+    Sample sample() const
+    {
+        const AllocationCount allocations = allocationsSoFar();
+        return {m_clock.nsecsElapsed(), allocations.count - m_ownAllocations.count, allocations.bytes - m_ownAllocations.bytes};
+    }
+
+    // Our own bookkeeping allocates too (the first time a call is seen, when the trace grows...),
+    // it shouldn't count towards the operation being measured
+    class Bookkeeping
+    {
+    public:
+        explicit Bookkeeping(const InstrumentedModel *model)
+            : m_model(const_cast<InstrumentedModel *>(model))
+            , m_start(allocationsSoFar())
+        {
+        }
+        ~Bookkeeping()
+        {
+            const AllocationCount end = allocationsSoFar();
+            m_model->m_ownAllocations.count += end.count - m_start.count;
+            m_model->m_ownAllocations.bytes += end.bytes - m_start.bytes;
+        }
+
+    private:
+        InstrumentedModel *m_model;
+        AllocationCount m_start;
+    };
+
+    // Times the calls made by the views (and counts their allocations), attributing them to the current operation
+    class Call
+    {
+    public:
+        Call(const InstrumentedModel *model, const char *name)
+            : m_model(const_cast<InstrumentedModel *>(model))
+            , m_name(name)
+            , m_start(m_model->sample())
+        {
+        }
+        ~Call() { m_model->finished(m_name, nullptr, m_start); }
+
+    private:
+        InstrumentedModel *m_model;
+        const char *m_name;
+        Sample m_start;
+    };
+
+    class Operation
+    {
+    public:
+        Operation(const InstrumentedModel *model, const char *name)
+            : m_model(const_cast<InstrumentedModel *>(model))
+            , m_name(name)
+        {
+            {
+                const Bookkeeping bookkeeping(m_model);
+                m_model->m_operations.push_back(name);
+            }
+            m_start = m_model->sample();
+        }
+        ~Operation() { m_model->finished(m_name, "operation", m_start, true); }
+
+    private:
+        InstrumentedModel *m_model;
+        const char *m_name;
+        Sample m_start;
+    };
+
+    void connectSignals(QAbstractItemModel *model, void (InstrumentedModel::*slot)(const char *))
+    {
+        // Lambdas rather than SIGNAL(): the signals have different arguments, and we only need their names
+#define INSTRUMENT_SIGNAL(signal) connect(model, &QAbstractItemModel::signal, this, [this, slot] { (this->*slot)(#signal); })
+        INSTRUMENT_SIGNAL(dataChanged);
+        INSTRUMENT_SIGNAL(headerDataChanged);
+        INSTRUMENT_SIGNAL(layoutAboutToBeChanged);
+        INSTRUMENT_SIGNAL(layoutChanged);
+        INSTRUMENT_SIGNAL(rowsAboutToBeInserted);
+        INSTRUMENT_SIGNAL(rowsInserted);
+        INSTRUMENT_SIGNAL(rowsAboutToBeRemoved);
+        INSTRUMENT_SIGNAL(rowsRemoved);
+        INSTRUMENT_SIGNAL(rowsAboutToBeMoved);
+        INSTRUMENT_SIGNAL(rowsMoved);
+        INSTRUMENT_SIGNAL(columnsInserted);
+        INSTRUMENT_SIGNAL(columnsRemoved);
+        INSTRUMENT_SIGNAL(modelAboutToBeReset);
+        INSTRUMENT_SIGNAL(modelReset);
+#undef INSTRUMENT_SIGNAL
+    }
+
+    void signalStarted(const char *signal)
+    {
+        Q_UNUSED(signal);
+        {
+            const Bookkeeping bookkeeping(this);
+            m_signalStarts.push_back({});
+        }
+        m_signalStarts.back() = sample();
+    }
+
+    void signalFinished(const char *signal)
+    {
+        if (m_signalStarts.empty())
+            return; // connected before the proxy, e.g. while setting the source model
+        const Sample start = m_signalStarts.back();
+        m_signalStarts.pop_back();
+        finished(signal, "signal", start);
+    }
+
+    // Records a call (no category, not traced, there are far too many of them), an operation or a signal
+    void finished(const char *name, const char *category, const Sample &start, bool endOfOperation = false)
+    {
+        const Sample end = sample();
+        const Bookkeeping bookkeeping(this);
+        const qint64 duration = end.nsecs - start.nsecs;
+        const quint64 allocations = end.allocations - start.allocations;
+        const quint64 allocatedBytes = end.allocatedBytes - start.allocatedBytes;
+        if (endOfOperation)
+            m_operations.pop_back(); // an operation is attributed to the enclosing one, if any
+        Stats &stats = m_stats[currentOperation()][name];
+        ++stats.count;
+        stats.nsecs += duration;
+        stats.allocations += allocations;
+        stats.allocatedBytes += allocatedBytes;
+        if (category && !m_traceFileName.isEmpty() && m_traceEvents.size() < s_maxTraceEvents)
+            m_traceEvents.push_back({name, category, start.nsecs, duration, allocations, allocatedBytes});
+    }
+
+    const char *currentOperation() const { return m_operations.empty() ? "(no DnD operation)" : m_operations.back(); }
+
+    void report()
+    {
+        if (m_stats.empty())
+            return;
+        qInfo().noquote() << "Model instrumentation for" << m_name;
+        for (const auto &operation : m_stats) {
+            qInfo().noquote() << " " << operation.first;
+            for (const auto &entry : operation.second) {
+                QString line = QStringLiteral("    %1: %2 times, %3 ms")
+                                   .arg(QLatin1String(entry.first), -24)
+                                   .arg(entry.second.count)
+                                   .arg(entry.second.nsecs / 1e6, 0, 'f', 3);
+#ifdef DND_COUNT_ALLOCATIONS
+                line += QStringLiteral(", %1 allocations (%2 bytes)").arg(entry.second.allocations).arg(entry.second.allocatedBytes);
+#endif
+                qInfo().noquote() << line;
+            }
+        }
+        m_stats.clear();
+
+        if (!m_traceFileName.isEmpty()) {
+            QJsonArray events;
+            for (const TraceEvent &event : m_traceEvents) {
+                events.append(QJsonObject{{"name", QLatin1String(event.name)},
+                                          {"cat", QLatin1String(event.category)},
+                                          {"ph", "X"}, // "complete" event, with a duration
+                                          {"ts", event.startNsecs / 1000.0}, // in microseconds
+                                          {"dur", event.durationNsecs / 1000.0},
+                                          {"pid", QCoreApplication::applicationPid()},
+                                          {"tid", 0},
+#ifdef DND_COUNT_ALLOCATIONS
+                                          {"args", QJsonObject{{"allocations", double(event.allocations)},
+                                                               {"bytes", double(event.allocatedBytes)}}},
+#endif
+                                         });
+            }
+            QFile file(m_traceFileName);
+            if (file.open(QIODevice::WriteOnly))
+                file.write(QJsonDocument(QJsonObject{{"traceEvents", events}}).toJson(QJsonDocument::Compact));
+            else
+                qWarning() << "Could not write" << m_traceFileName << file.errorString();
+            m_traceEvents.clear();
+        }
+    }
+
+    static constexpr size_t s_maxTraceEvents = 1000000; // the trace of a long session would fill up the memory
+
+    const QString m_name;
+    QString m_traceFileName;
+    QElapsedTimer m_clock;
+    std::vector<const char *> m_operations; // the operations running, innermost last
+    std::vector<Sample> m_signalStarts;
+    AllocationCount m_ownAllocations = {0, 0}; // made by the bookkeeping, subtracted from the counts
+    // Keyed by pointer rather than by string, the names are all string literals
+    std::map<const char *, std::map<const char *, Stats>> m_stats; // by operation, then by signal or call
+    std::vector<TraceEvent> m_traceEvents;
+};
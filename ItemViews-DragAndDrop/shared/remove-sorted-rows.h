@@ -0,0 +1,38 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+#pragma once
+
+#include <QAbstractItemModel>
+#include <QVector>
+
+// Removes the given rows (sorted, without duplicates) from `list` and from `model`, which shows that list.
+// The list is compacted in a single pass, and the rows are removed from the model one range of consecutive rows
+// at a time, rather than one by one, which would be O(n) each.
+template<typename List>
+void removeSortedRows(List &list, QAbstractItemModel *model, const QVector<int> &rows)
+{
+    if (rows.isEmpty())
+        return;
+    // Remove from data structure
+    int destRow = rows.first();
+    for (int row = rows.first(), i = 0; row < list.size(); ++row) {
+        if (i < rows.size() && rows.at(i) == row)
+            ++i;
+        else
+            list[destRow++] = list.at(row);
+    }
+    list.erase(list.begin() + destRow, list.end());
+
+    // Remove from UI, starting from the end so that the rows before are still valid
+    for (int end = rows.size(); end > 0;) {
+        int begin = end - 1;
+        while (begin > 0 && rows.at(begin - 1) == rows.at(begin) - 1)
+            --begin;
+        model->removeRows(rows.at(begin), end - begin);
+        end = begin;
+    }
+}
@@ -0,0 +1,172 @@
+/*
+  SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+
+  SPDX-License-Identifier: MIT
+*/
+
+#pragma once
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QRandomGenerator>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+
+// Generates large amounts of realistic-looking data, for testing how the examples scale
+// (the built-in data only has a handful of rows, so scaling problems never show up with it).
+// The same seed always generates the same data, so that timings can be compared between runs.
+class SyntheticData
+{
+public:
+    explicit SyntheticData(quint32 seed = 1)
+        : m_random(seed)
+    {
+    }
+
+    // Seeds derived from a string, e.g. a folder path, so that parts of the data can be generated
+    // independently of each other (and lazily), and still be the same every time
+    static quint32 seedFor(quint32 seed, const QString &key)
+    {
+        quint32 hash = 2166136261u ^ seed; // FNV-1a, qHash() isn't the same on all machines
+        for (const QChar c : key)
+            hash = (hash ^ c.unicode()) * 16777619u;
+        return hash;
+    }
+
+    QRandomGenerator &random() { return m_random; }
+
+    // Uniform in [min, max]
+    int uniform(int min, int max) { return min + int(m_random.bounded(max - min + 1)); }
+
+    // In [min, max], with a few big values and many small ones: the bigger `power`, the more skewed
+    int skewed(int min, int max, double power = 3.0)
+    {
+        return min + int(std::pow(m_random.generateDouble(), power) * (max - min + 1) * 0.9999);
+    }
+
+    // True with the given probability
+    bool chance(double probability) { return m_random.generateDouble() < probability; }
+
+    // A made-up, pronounceable name, such as "Moravia" or "Kelindor"
+    QString name(int minSyllables = 2, int maxSyllables = 4)
+    {
+        static const char *const syllables[] = {"ba", "da",  "ka",  "la",  "ma",  "na",  "ra", "sa", "ta", "vi",
+                                                "lo", "ne",  "ru",  "so",  "ki",  "mo",  "te", "ga", "po", "lin",
+                                                "dor", "sta", "bri", "chen", "vel", "ton", "ul", "ia", "an", "en"};
+        const int syllableCount = int(sizeof(syllables) / sizeof(syllables[0]));
+        const int count = uniform(minSyllables, maxSyllables);
+        QString result;
+        for (int i = 0; i < count; ++i)
+            result += QLatin1String(syllables[m_random.bounded(syllableCount)]);
+        result[0] = result.at(0).toUpper();
+        return result;
+    }
+
+    // Some words, common ones more often than rare ones
+    QString sentence(int minWords, int maxWords)
+    {
+        static const char *const words[] = {"the",     "meeting", "report",  "about",    "new",     "project", "update",
+                                            "invoice", "quick",   "question", "your",    "order",   "weekly",  "team",
+                                            "review",  "draft",   "plan",    "budget",   "release", "notes",   "follow-up",
+                                            "lunch",   "schedule", "travel", "contract", "feedback", "urgent", "photos"};
+        const int wordCount = int(sizeof(words) / sizeof(words[0]));
+        const int count = uniform(minWords, maxWords);
+        QStringList result;
+        result.reserve(count);
+        for (int i = 0; i < count; ++i)
+            result.append(QLatin1String(words[skewed(0, wordCount - 1, 2.0)]));
+        result[0][0] = result.at(0).at(0).toUpper();
+        return result.join(QLatin1Char(' '));
+    }
+
+    // Sizes for `count` buckets adding up to `total`, following Zipf's law (the k-th biggest bucket is k times
+    // smaller than the biggest one), in random order. E.g. email folders: a few huge ones and a long tail of small ones.
+    QVector<int> zipfSizes(int count, qint64 total, double exponent = 1.0)
+    {
+        QVector<int> sizes(count);
+        if (count == 0)
+            return sizes;
+        QVector<double> weights(count);
+        double weightSum = 0;
+        for (int rank = 0; rank < count; ++rank) {
+            weights[rank] = 1.0 / std::pow(rank + 1, exponent);
+            weightSum += weights.at(rank);
+        }
+        qint64 remaining = total;
+        for (int rank = 0; rank < count; ++rank) {
+            sizes[rank] = int(total * weights.at(rank) / weightSum);
+            remaining -= sizes.at(rank);
+        }
+        for (int rank = 0; remaining > 0; rank = (rank + 1) % count, --remaining) // rounding errors
+            ++sizes[rank];
+        for (int i = count - 1; i > 0; --i) // Fisher-Yates shuffle
+            std::swap(sizes[i], sizes[m_random.bounded(i + 1)]);
+        return sizes;
+    }
+
+    // A tree in the text format of the treemodel examples (default.txt): one node per line, indented by 4 spaces
+    // per level, with tab-separated columns. The fan-out is skewed: `fanout` top-level nodes, and then many nodes
+    // with a few children and some with many, `fanout` on average.
+    QString treeText(int depth, int fanout)
+    {
+        QString text;
+        appendTreeNodes(text, 0, depth, fanout, fanout);
+        return text;
+    }
+
+    // Email folders for the part3 examples, `emailsPerFolder` emails on average, with Zipfian folder sizes.
+    // `Folders` is a container of structs with a `folderName` QString and an `emails` QStringList of subjects.
+    template<typename Folders>
+    Folders emailFolders(int folderCount, int emailsPerFolder)
+    {
+        const QVector<int> folderSizes = zipfSizes(folderCount, qint64(folderCount) * emailsPerFolder);
+        Folders folders;
+        folders.reserve(folderCount);
+        for (int folderSize : folderSizes) {
+            typename Folders::value_type folder;
+            folder.folderName = name();
+            folder.emails.reserve(folderSize);
+            for (int i = 0; i < folderSize; ++i)
+                folder.emails.append(sentence(2, 6));
+            folders.append(folder);
+        }
+        return folders;
+    }
+
+private:
+    void appendTreeNodes(QString &text, int level, int depth, int count, int fanout)
+    {
+        for (int i = 0; i < count; ++i) {
+            text += QString(level * 4, QLatin1Char(' ')) + name() + QLatin1Char('\t') + sentence(3, 8) + QLatin1Char('\n');
+            if (level + 1 < depth)
+                appendTreeNodes(text, level + 1, depth, skewed(0, 4 * fanout), fanout);
+        }
+    }
+
+    QRandomGenerator m_random;
+};
+
+// The command line options for generating data instead of using the built-in data.
+// Each example only adds the ones that make sense for it.
+struct SyntheticDataOptions
+{
+    QCommandLineOption rows{"rows", "Generate <n> rows of data instead of using the built-in data.", "n"};
+    QCommandLineOption depth{"depth", "Generate a tree with <n> levels instead of using the built-in data.", "n"};
+    QCommandLineOption fanout{"fanout", "Number of children of each node in generated trees, on average (default: 5).", "n", "5"};
+    QCommandLineOption folders{"folders", "Generate <n> email folders instead of using the built-in data.", "n"};
+    QCommandLineOption emailsPerFolder{"emails-per-folder",
+                                       "Number of emails per generated folder, on average; folder sizes follow Zipf's law (default: 100).", "n",
+                                       "100"};
+    QCommandLineOption generateFile{"generate-file", "Write the generated rows to <file>, for opening it later, instead of showing them.",
+                                    "file"};
+    QCommandLineOption seed{"seed", "Seed for the generated data, the same seed always generates the same data (default: 1).", "n", "1"};
+
+    static int intValue(const QCommandLineParser &parser, const QCommandLineOption &option)
+    {
+        return std::max(0, parser.value(option).toInt());
+    }
+};